@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+
+struct CorpusSettings {
+  int page_count{ 50 };
+  // value of the pages' /Rotate entry
+  int rotation{ };
+  bool landscape{ };
+  bool header{ };
+  bool footer{ };
+  // every n-th page is blank or has wider content
+  int blank_every{ };
+  int outlier_every{ };
+  unsigned int seed{ 1 };
+};
+
+void generate_pdf(const CorpusSettings& settings,
+  const std::filesystem::path& filename);
+
+int bench_scan();
+int bench_stages(const std::filesystem::path& filename);
+int bench_scaling(const std::filesystem::path& filename);
+int bench_sampling(const std::filesystem::path& filename);
+int bench_boxes(const std::filesystem::path& filename);
+
+// results are printed as one JSON object per line
+void print_json(const char* format, ...);
+
+template <typename F>
+double measure(int iterations, F&& function) {
+  const auto start = std::chrono::steady_clock::now();
+  for (auto i = 0; i < iterations; ++i)
+    function();
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
@@ -0,0 +1,64 @@
+#include "bench.h"
+#include "boxes.h"
+#include "optimize.h"
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <vector>
+
+namespace {
+  // the JSON format is written with three decimals
+  bool is_same_page(const Page& a, const Page& b) {
+    const auto& x = a.bounding_box;
+    const auto& y = b.bounding_box;
+    return std::max({ std::abs(x.llx - y.llx), std::abs(x.lly - y.lly),
+      std::abs(x.urx - y.urx), std::abs(x.ury - y.ury) }) <= 0.001 &&
+      a.blank == b.blank;
+  }
+} // namespace
+
+// writes the crop boxes in both formats and reads them back, like
+// --analyze-only followed by --apply-boxes. fails, when a crop box or
+// a blank flag differs.
+int bench_boxes(const std::filesystem::path& filename) {
+  auto settings = Settings{ };
+  settings.input_file = filename;
+  settings.blank_pages = BlankPages::drop;
+
+  auto pages = analyze_pages(settings);
+  if (pages.empty())
+    return 1;
+  optimize_boxes(settings, pages);
+  const auto blank_pages = static_cast<int>(std::count_if(pages.begin(),
+    pages.end(), [](const Page& page) { return page.blank; }));
+
+  auto result = 0;
+  for (auto format : { BoxFormat::json, BoxFormat::binary }) {
+    const auto json = (format == BoxFormat::json);
+    const auto boxes_file = std::filesystem::temp_directory_path() /
+      (json ? "pdfautocrop_bench_boxes.json" : "pdfautocrop_bench_boxes.bin");
+    auto read = std::optional<std::vector<std::vector<Page>>>();
+    const auto round_trip_ms = measure(1, [&]() {
+      {
+        auto writer = BoxWriter();
+        if (!writer.open(boxes_file, format))
+          return;
+        writer.write_crop_boxes(0, pages);
+      }
+      read = read_crop_boxes(boxes_file);
+    });
+    std::filesystem::remove(boxes_file);
+
+    const auto same = (read && read->size() == 1 &&
+      std::equal(pages.begin(), pages.end(), read->front().begin(),
+        read->front().end(), is_same_page));
+    print_json("\"benchmark\": \"boxes\", \"file\": \"%s\", \"format\": \"%s\", "
+      "\"pages\": %d, \"blank\": %d, \"round_trip_ms\": %.3f, \"same\": %s",
+      filename.filename().u8string().c_str(), (json ? "json" : "binary"),
+      static_cast<int>(pages.size()), blank_pages, round_trip_ms,
+      (same ? "true" : "false"));
+    if (!same)
+      result = 1;
+  }
+  return result;
+}
@@ -0,0 +1,92 @@
+
+#include "bench.h"
+#include <qpdf/QPDF.hh>
+#include <qpdf/QPDFPageDocumentHelper.hh>
+#include <qpdf/QPDFPageObjectHelper.hh>
+#include <qpdf/QPDFWriter.hh>
+#include <random>
+#include <sstream>
+
+namespace {
+  const auto page_width = 595.0;
+  const auto page_height = 842.0;
+  const auto margin = 72.0;
+  const auto line_height = 12.0;
+
+  void add_rect(std::ostream& os, double x, double y, double w, double h) {
+    os << x << " " << y << " " << w << " " << h << " re f\n";
+  }
+
+  // draws filled rectangles instead of glyphs, which look the same
+  // to the analysis and do not require any fonts
+  std::string generate_content(const CorpusSettings& settings,
+      int page_index, double width, double height, std::mt19937& random) {
+    auto os = std::ostringstream();
+    os << "0 g\n";
+
+    const auto blank = (settings.blank_every &&
+      (page_index + 1) % settings.blank_every == 0);
+    if (blank)
+      return os.str();
+
+    // content of facing pages is shifted towards the binding
+    const auto shift = (page_index % 2 ? -10.0 : 10.0);
+    const auto left = margin + shift;
+    const auto right = width - margin + shift;
+    auto top = height - margin;
+    auto bottom = margin;
+
+    if (settings.header) {
+      add_rect(os, left, top - 6, 180, 6);
+      add_rect(os, left, top - 12, right - left, 0.5);
+      top -= 30;
+    }
+    if (settings.footer) {
+      add_rect(os, (left + right) / 2 - 8, bottom, 16, 6);
+      bottom += 30;
+    }
+
+    auto line_length = std::uniform_real_distribution<double>(0.3, 1.0);
+    auto paragraph = std::uniform_int_distribution<int>(0, 9);
+    for (auto y = top - line_height; y > bottom; y -= line_height) {
+      const auto last_line = !paragraph(random);
+      add_rect(os, left, y, (right - left) * (last_line ? line_length(random) : 1.0), 7);
+      if (last_line)
+        y -= line_height / 2;
+    }
+
+    const auto outlier = (settings.outlier_every &&
+      (page_index + 1) % settings.outlier_every == 0);
+    if (outlier)
+      add_rect(os, margin / 3, (top + bottom) / 2 - 100, width - margin * 2 / 3, 200);
+
+    return os.str();
+  }
+} // namespace
+
+void generate_pdf(const CorpusSettings& settings,
+    const std::filesystem::path& filename) {
+  auto pdf = QPDF();
+  pdf.emptyPDF();
+
+  const auto width = (settings.landscape ? page_height : page_width);
+  const auto height = (settings.landscape ? page_width : page_height);
+  auto random = std::mt19937(settings.seed);
+  auto pages = QPDFPageDocumentHelper(pdf);
+  for (auto i = 0; i < settings.page_count; ++i) {
+    auto contents = QPDFObjectHandle::newStream(&pdf,
+      generate_content(settings, i, width, height, random));
+    auto page = QPDFObjectHandle::newDictionary();
+    page.replaceKey("/Type", QPDFObjectHandle::newName("/Page"));
+    page.replaceKey("/MediaBox", QPDFObjectHandle::newArray(
+      QPDFObjectHandle::Rectangle(0, 0, width, height)));
+    page.replaceKey("/Contents", contents);
+    page.replaceKey("/Resources", QPDFObjectHandle::newDictionary());
+    if (settings.rotation)
+      page.replaceKey("/Rotate", QPDFObjectHandle::newInteger(settings.rotation));
+    pages.addPage(QPDFPageObjectHelper(pdf.makeIndirectObject(page)), false);
+  }
+
+  auto writer = QPDFWriter(pdf, filename.u8string().c_str());
+  writer.write();
+}
@@ -0,0 +1,168 @@
+
+#include "bench.h"
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+#include <vector>
+
+namespace {
+  void print_help_message() {
+    std::printf(
+      "Usage: pdfautocrop_bench [-options] [input...]\n"
+      "  Without input, synthetic files are generated and benchmarked.\n"
+      "  --scan                 only run the bitmap scanning benchmark.\n"
+      "  --scaling              only measure pages per second per worker count.\n"
+      "  --sampling             only compare sampled with full analysis.\n"
+      "  --boxes                only check reading back written crop boxes.\n"
+      "  --generate <file>      only write a synthetic PDF file.\n"
+      "    --pages <n>          number of pages (default: 50).\n"
+      "    --rotate <degrees>   value of the pages' /Rotate entry.\n"
+      "    --landscape          swap width and height of the pages.\n"
+      "    --header             add a header to each page.\n"
+      "    --footer             add a footer to each page.\n"
+      "    --blank <n>          make every n-th page blank.\n"
+      "    --outlier <n>        give every n-th page wider content.\n");
+  }
+
+  // a few variants, covering the different stages
+  int bench_corpus() {
+    struct Variant {
+      const char* name;
+      CorpusSettings settings;
+    };
+    auto variants = std::vector<Variant>{
+      { "plain", { } },
+      { "header_footer", { } },
+      { "rotated", { } },
+      { "blank_outlier", { } },
+    };
+    variants[1].settings.header = true;
+    variants[1].settings.footer = true;
+    variants[2].settings.rotation = 90;
+    variants[2].settings.landscape = true;
+    variants[3].settings.blank_every = 7;
+    variants[3].settings.outlier_every = 5;
+
+    auto result = 0;
+    for (const auto& variant : variants) {
+      const auto filename = std::filesystem::temp_directory_path() /
+        (std::string("pdfautocrop_bench_") + variant.name + ".pdf");
+      generate_pdf(variant.settings, filename);
+      result |= bench_stages(filename);
+      std::filesystem::remove(filename);
+    }
+    return result;
+  }
+} // namespace
+
+void print_json(const char* format, ...) {
+  std::printf("{ ");
+  va_list args;
+  va_start(args, format);
+  std::vprintf(format, args);
+  va_end(args);
+  std::printf(" }\n");
+}
+
+int main(int argc, const char* argv[]) try {
+  auto corpus = CorpusSettings{ };
+  auto generate_file = std::filesystem::path();
+  auto input_files = std::vector<std::filesystem::path>();
+  auto scan_only = false;
+  auto scaling_only = false;
+  auto sampling_only = false;
+  auto boxes_only = false;
+
+  for (auto i = 1; i < argc; ++i) {
+    const auto argument = std::string_view(argv[i]);
+    const auto get_int = [&]() {
+      return (i + 1 < argc ? std::atoi(argv[++i]) : 0);
+    };
+    if (argument == "--scan") {
+      scan_only = true;
+    }
+    else if (argument == "--scaling") {
+      scaling_only = true;
+    }
+    else if (argument == "--sampling") {
+      sampling_only = true;
+    }
+    else if (argument == "--boxes") {
+      boxes_only = true;
+    }
+    else if (argument == "--generate" && i + 1 < argc) {
+      generate_file = std::filesystem::u8path(argv[++i]);
+    }
+    else if (argument == "--pages") {
+      corpus.page_count = get_int();
+    }
+    else if (argument == "--rotate") {
+      corpus.rotation = get_int();
+    }
+    else if (argument == "--landscape") {
+      corpus.landscape = true;
+    }
+    else if (argument == "--header") {
+      corpus.header = true;
+    }
+    else if (argument == "--footer") {
+      corpus.footer = true;
+    }
+    else if (argument == "--blank") {
+      corpus.blank_every = get_int();
+    }
+    else if (argument == "--outlier") {
+      corpus.outlier_every = get_int();
+    }
+    else if (!argument.empty() && argument.front() != '-') {
+      input_files.push_back(std::filesystem::u8path(argv[i]));
+    }
+    else {
+      print_help_message();
+      return 1;
+    }
+  }
+
+  if (!generate_file.empty()) {
+    generate_pdf(corpus, generate_file);
+    return 0;
+  }
+
+  if (scaling_only || sampling_only || boxes_only) {
+    const auto bench = (scaling_only ? bench_scaling :
+                        sampling_only ? bench_sampling : bench_boxes);
+    if (!input_files.empty()) {
+      auto result = 0;
+      for (const auto& input_file : input_files)
+        result |= bench(input_file);
+      return result;
+    }
+    // the crop boxes are read back together with the blank flags
+    if (boxes_only && !corpus.blank_every)
+      corpus.blank_every = 7;
+    const auto filename = std::filesystem::temp_directory_path() /
+      (scaling_only ? "pdfautocrop_bench_scaling.pdf" :
+       sampling_only ? "pdfautocrop_bench_sampling.pdf" :
+                       "pdfautocrop_bench_boxes.pdf");
+    generate_pdf(corpus, filename);
+    const auto result = bench(filename);
+    std::filesystem::remove(filename);
+    return result;
+  }
+
+  auto result = bench_scan();
+  if (scan_only)
+    return result;
+
+  if (input_files.empty())
+    return result | bench_corpus();
+
+  for (const auto& input_file : input_files)
+    result |= bench_stages(input_file);
+  return result;
+}
+catch (const std::exception& ex) {
+  std::fprintf(stderr, "unhandled exception: %s\n", ex.what());
+  return 1;
+}
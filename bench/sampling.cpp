@@ -0,0 +1,59 @@
+#include "bench.h"
+#include "optimize.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+  double get_deviation(const Box& a, const Box& b) {
+    return std::max({ std::abs(a.llx - b.llx), std::abs(a.lly - b.lly),
+      std::abs(a.urx - b.urx), std::abs(a.ury - b.ury) });
+  }
+} // namespace
+
+// compares the crop boxes of the sampled analysis with the full analysis.
+// fails, when a page deviates by more than two pixels at the resolution
+// of the estimated pages.
+int bench_sampling(const std::filesystem::path& filename) {
+  auto settings = Settings{ };
+  settings.input_file = filename;
+  settings.crop_header_size = 100;
+  settings.crop_footer_size = 100;
+  settings.crop_outlier = true;
+
+  auto full = std::vector<Page>();
+  const auto full_ms = measure(1, [&]() { full = analyze_pages(settings); });
+  const auto page_count = static_cast<int>(full.size());
+  if (!page_count)
+    return 1;
+  optimize_boxes(settings, full);
+
+  auto sampled_settings = settings;
+  sampled_settings.sample_pages = std::max(page_count / 5, 2);
+  auto sampled = std::vector<Page>();
+  const auto sampled_ms = measure(1, [&]() {
+    sampled = analyze_pages(sampled_settings);
+  });
+  if (sampled.size() != full.size())
+    return 1;
+  optimize_boxes(sampled_settings, sampled);
+
+  const auto tolerance = 2 * 72 / std::max(settings.resolution / 2, 18.0);
+  auto max_deviation = 0.0;
+  auto pages_exceeding = 0;
+  for (auto i = 0; i < page_count; ++i) {
+    const auto deviation = get_deviation(full[i].bounding_box,
+      sampled[i].bounding_box);
+    max_deviation = std::max(max_deviation, deviation);
+    if (deviation > tolerance)
+      ++pages_exceeding;
+  }
+
+  print_json("\"benchmark\": \"sampling\", \"file\": \"%s\", \"pages\": %d, "
+    "\"sample\": %d, \"full_ms\": %.3f, \"sampled_ms\": %.3f, "
+    "\"speedup\": %.2f, \"max_deviation\": %.3f, \"tolerance\": %.3f, "
+    "\"pages_exceeding\": %d", filename.filename().u8string().c_str(),
+    page_count, sampled_settings.sample_pages, full_ms, sampled_ms,
+    full_ms / sampled_ms, max_deviation, tolerance, pages_exceeding);
+  return (pages_exceeding ? 1 : 0);
+}
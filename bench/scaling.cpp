@@ -0,0 +1,55 @@
+
+#include "bench.h"
+#include "input.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// measures the pages per second of the analysis for an increasing number
+// of workers, which either share the document, parse it on their own or
+// are forked processes
+int bench_scaling(const std::filesystem::path& filename) {
+  struct Mode {
+    const char* name;
+    bool worker_documents;
+    bool processes;
+  };
+  const auto modes = {
+    Mode{ "shared_document", false, false },
+    Mode{ "worker_documents", true, false },
+#if !defined(_WIN32)
+    Mode{ "processes", false, true },
+#endif
+  };
+
+  const auto cores = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+  auto worker_counts = std::vector<int>();
+  for (auto count = 1; count < cores; count *= 2)
+    worker_counts.push_back(count);
+  worker_counts.push_back(cores);
+
+  auto settings = Settings{ };
+  settings.input_file = filename;
+  const auto file = filename.filename().u8string();
+  auto single_ms = 0.0;
+  for (const auto& mode : modes)
+    for (auto workers : worker_counts) {
+      settings.jobs = workers;
+      settings.worker_documents = mode.worker_documents;
+      settings.processes = (mode.processes ? workers : 0);
+      auto page_count = 0;
+      const auto ms = measure(1, [&]() {
+        page_count = static_cast<int>(analyze_pages(settings).size());
+      });
+      if (!page_count)
+        return 1;
+      if (!single_ms)
+        single_ms = ms;
+      print_json("\"benchmark\": \"scaling\", \"file\": \"%s\", "
+        "\"mode\": \"%s\", \"workers\": %d, \"pages\": %d, \"ms\": %.3f, "
+        "\"pages_per_second\": %.1f, \"speedup\": %.2f",
+        file.c_str(), mode.name, workers, page_count, ms,
+        page_count * 1000.0 / ms, single_ms / ms);
+    }
+  return 0;
+}
@@ -0,0 +1,112 @@
+
+#include "bench.h"
+#include "scan.h"
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+  struct Buffer {
+    std::vector<char> data;
+    Bitmap bitmap;
+  };
+
+  // white page with a block of random ink, like a page of text
+  Buffer generate_page(int width, int height, int margin) {
+    auto buffer = Buffer{ std::vector<char>(width * height, '\xFF'), { } };
+    auto random = std::mt19937(1);
+    auto ink = std::uniform_int_distribution<int>(0, 15);
+    for (auto y = margin; y < height - margin; ++y)
+      for (auto x = margin; x < width - margin; ++x)
+        if (!ink(random))
+          buffer.data[y * width + x] = static_cast<char>(ink(random) * 8);
+    buffer.bitmap = { buffer.data.data(), width, height, width };
+    return buffer;
+  }
+
+  // previous implementation, comparing one byte at a time and
+  // walking down the columns
+  Bounds get_used_bounds_reference(const Bitmap& bitmap, const Bounds& rect,
+      char background_color) {
+    const auto has_background_color = [&](int x0, int y0, int x1, int y1) {
+      for (auto y = y0; y < y1; ++y)
+        for (auto x = x0; x < x1; ++x)
+          if (bitmap.data[y * bitmap.bytes_per_row + x] != background_color)
+            return false;
+      return true;
+    };
+    const auto x1 = rect.right - 1;
+    const auto y1 = rect.bottom - 1;
+    auto min_y = rect.top;
+    for (; min_y < y1; ++min_y)
+      if (!has_background_color(rect.left, min_y, rect.right, min_y + 1))
+        break;
+    auto max_y = y1;
+    for (; max_y > min_y; --max_y)
+      if (!has_background_color(rect.left, max_y, rect.right, max_y + 1))
+        break;
+    auto min_x = rect.left;
+    for (; min_x < x1; ++min_x)
+      if (!has_background_color(min_x, min_y, min_x + 1, max_y + 1))
+        break;
+    auto max_x = x1;
+    for (; max_x > min_x; --max_x)
+      if (!has_background_color(max_x, min_y, max_x + 1, max_y + 1))
+        break;
+    return { min_x, min_y, max_x + 1, max_y + 1 };
+  }
+
+  // keeps results from being optimized away
+  volatile int g_sink;
+
+  const char* get_name(ScanKernel kernel) {
+    switch (kernel) {
+      case ScanKernel::scalar: return "scalar";
+      case ScanKernel::sse2: return "sse2";
+      case ScanKernel::avx2: return "avx2";
+    }
+    return "";
+  }
+
+  bool equal(const Bounds& a, const Bounds& b) {
+    return a.left == b.left && a.top == b.top &&
+           a.right == b.right && a.bottom == b.bottom;
+  }
+} // namespace
+
+int bench_scan() {
+  struct Size { int width; int height; int margin; };
+  const auto iterations = 20;
+  const auto default_kernel = get_scan_kernel();
+  auto result = 0;
+
+  for (auto size : { Size{ 794, 1123, 90 }, Size{ 2480, 3508, 280 } }) {
+    const auto page = generate_page(size.width, size.height, size.margin);
+    const auto rect = Bounds{ 0, 0, size.width, size.height };
+    const auto white = Background{ 0xFF, 0xFF, false };
+    const auto expected = get_used_bounds_reference(page.bitmap, rect, '\xFF');
+    const auto reference = measure(iterations, [&]() {
+      g_sink = get_used_bounds_reference(page.bitmap, rect, '\xFF').left;
+    });
+    print_json("\"benchmark\": \"get_used_bounds\", \"kernel\": \"reference\", "
+      "\"width\": %d, \"height\": %d, \"ms\": %.4f, \"speedup\": %.2f",
+      size.width, size.height, reference, 1.0);
+
+    for (auto kernel : { ScanKernel::scalar, ScanKernel::sse2, ScanKernel::avx2 }) {
+      if (!set_scan_kernel(kernel))
+        continue;
+      if (!equal(get_used_bounds(page.bitmap, rect, white), expected)) {
+        std::fprintf(stderr, "%s kernel returned wrong bounds\n", get_name(kernel));
+        result = 1;
+      }
+      const auto ms = measure(iterations, [&]() {
+        g_sink = get_used_bounds(page.bitmap, rect, white).left;
+      });
+      print_json("\"benchmark\": \"get_used_bounds\", \"kernel\": \"%s\", "
+        "\"width\": %d, \"height\": %d, \"ms\": %.4f, \"speedup\": %.2f",
+        get_name(kernel), size.width, size.height, ms, reference / ms);
+    }
+  }
+  set_scan_kernel(default_kernel);
+  return result;
+}
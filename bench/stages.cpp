@@ -0,0 +1,119 @@
+
+#include "bench.h"
+#include "image.h"
+#include "optimize.h"
+#include "output.h"
+#include <poppler/cpp/poppler-document.h>
+#include <poppler/cpp/poppler-page-renderer.h>
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+
+namespace {
+  volatile int g_sink;
+
+  struct StageTimes {
+    double render{ };
+    double bounds{ };
+    double header_footer{ };
+  };
+
+  template <typename F>
+  auto measure_add(double& total, F&& function) {
+    const auto start = std::chrono::steady_clock::now();
+    auto result = function();
+    const auto end = std::chrono::steady_clock::now();
+    total += std::chrono::duration<double, std::milli>(end - start).count();
+    return result;
+  }
+
+  // times the stages of analyze_pages for each page on a single thread
+  bool measure_analysis_stages(const Settings& settings, StageTimes& times) {
+    const auto document = std::unique_ptr<poppler::document>(
+      poppler::document::load_from_file(settings.input_file.u8string()));
+    if (!document)
+      return false;
+
+    auto renderer = poppler::page_renderer();
+    renderer.set_image_format(Image::format_gray8);
+    renderer.set_render_hint(poppler::page_renderer::antialiasing);
+    renderer.set_render_hint(poppler::page_renderer::text_antialiasing);
+    renderer.set_render_hint(poppler::page_renderer::text_hinting);
+
+    for (auto i = 0; i < document->pages(); ++i) {
+      const auto page = std::unique_ptr<poppler::page>(document->create_page(i));
+      const auto orientation = page->orientation();
+      const auto image = measure_add(times.render, [&]() {
+        return renderer.render_page(page.get(),
+          settings.resolution, settings.resolution);
+      });
+      const auto background = guess_background(image, false);
+      const auto page_bounds = measure_add(times.bounds, [&]() {
+        return get_used_bounds(image, background, orientation);
+      });
+      g_sink = measure_add(times.header_footer, [&]() {
+        const auto height = get_unrotated_height(image, orientation);
+        const auto scale_y = page->page_rect().height() / height;
+        const auto profile = get_row_profile(image, page_bounds,
+          background, orientation);
+        const auto header_size = guess_header_size(profile, page_bounds,
+          static_cast<int>(settings.crop_header_size / scale_y), height);
+        const auto footer_size = guess_footer_size(profile, page_bounds,
+          static_cast<int>(settings.crop_footer_size / scale_y), height);
+        return get_used_bounds(profile, indent_bounds(page_bounds,
+          header_size, footer_size)).top();
+      });
+    }
+    return true;
+  }
+} // namespace
+
+int bench_stages(const std::filesystem::path& filename) {
+  auto settings = Settings{ };
+  settings.input_file = filename;
+  settings.output_file = std::filesystem::temp_directory_path() /
+    "pdfautocrop_bench_output.pdf";
+  settings.crop_header_size = 100;
+  settings.crop_footer_size = 100;
+  settings.crop_outlier = true;
+
+  auto times = StageTimes{ };
+  if (!measure_analysis_stages(settings, times)) {
+    std::fprintf(stderr, "%s: reading input file failed\n",
+      filename.u8string().c_str());
+    return 1;
+  }
+
+  auto pages = std::vector<Page>();
+  const auto analyze = measure(1, [&]() { pages = analyze_pages(settings); });
+  const auto optimize_iterations = 20;
+  const auto optimize = measure(optimize_iterations, [&]() {
+    auto copy = pages;
+    optimize_boxes(settings, copy);
+  });
+  auto optimized = pages;
+  optimize_boxes(settings, optimized);
+  const auto write = measure(1, [&]() { output_pages(settings, optimized); });
+  auto rewrite_settings = settings;
+  rewrite_settings.full_rewrite = true;
+  const auto rewrite = measure(1, [&]() {
+    output_pages(rewrite_settings, optimized);
+  });
+  std::filesystem::remove(settings.output_file);
+
+  const auto file = filename.filename().u8string();
+  const auto page_count = static_cast<int>(pages.size());
+  const auto print_stage = [&](const char* stage, double ms) {
+    print_json("\"benchmark\": \"stage\", \"file\": \"%s\", \"pages\": %d, "
+      "\"stage\": \"%s\", \"ms\": %.3f, \"ms_per_page\": %.4f",
+      file.c_str(), page_count, stage, ms, ms / std::max(page_count, 1));
+  };
+  print_stage("render", times.render);
+  print_stage("bounds", times.bounds);
+  print_stage("header_footer", times.header_footer);
+  print_stage("analyze", analyze);
+  print_stage("optimize", optimize);
+  print_stage("write", write);
+  print_stage("rewrite", rewrite);
+  return 0;
+}
@@ -0,0 +1,246 @@
+
+#include "boxes.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#if defined(_WIN32)
+#  include <fcntl.h>
+#  include <io.h>
+#endif
+
+namespace {
+  const char binary_magic[4] = { 'P', 'A', 'C', 'B' };
+  enum RecordType : char { page_record = 1, crop_box_record = 2 };
+
+  const auto page_values = 22;
+  const auto crop_box_values = 5;
+
+  void append(std::vector<double>& values, const Box& box) {
+    values.insert(values.end(), { box.llx, box.lly, box.urx, box.ury });
+  }
+
+  std::string format_box(const Box& box) {
+    char buffer[128];
+    std::snprintf(buffer, sizeof(buffer), "[%.3f, %.3f, %.3f, %.3f]",
+      box.llx, box.lly, box.urx, box.ury);
+    return buffer;
+  }
+
+  void set_crop_box(std::vector<std::vector<Page>>& documents,
+      int index, int page_index, const Box& box, bool blank) {
+    if (index < 0 || page_index < 0)
+      return;
+    if (static_cast<size_t>(index) >= documents.size())
+      documents.resize(static_cast<size_t>(index) + 1);
+    auto& pages = documents[static_cast<size_t>(index)];
+    if (static_cast<size_t>(page_index) >= pages.size())
+      pages.resize(static_cast<size_t>(page_index) + 1);
+    auto& page = pages[static_cast<size_t>(page_index)];
+    page.bounding_box = box;
+    page.blank = blank;
+  }
+
+  // only the values written by the BoxWriter need to be found
+  bool find_int(const std::string& line, const char* key, int& value) {
+    const auto pos = line.find(key);
+    if (pos == std::string::npos)
+      return false;
+    value = std::atoi(line.c_str() + pos + std::strlen(key));
+    return true;
+  }
+
+  bool find_bool(const std::string& line, const char* key, bool& value) {
+    const auto pos = line.find(key);
+    if (pos == std::string::npos)
+      return false;
+    const auto it = line.c_str() + pos + std::strlen(key);
+    value = (std::strncmp(it + std::strspn(it, " "), "true", 4) == 0);
+    return true;
+  }
+
+  bool find_box(const std::string& line, const char* key, Box& box) {
+    const auto pos = line.find(key);
+    if (pos == std::string::npos)
+      return false;
+    auto it = line.c_str() + pos + std::strlen(key);
+    double values[4];
+    for (auto& value : values) {
+      it += std::strspn(it, " ,[");
+      auto end = static_cast<char*>(nullptr);
+      value = std::strtod(it, &end);
+      if (end == it)
+        return false;
+      it = end;
+    }
+    box = { values[0], values[1], values[2], values[3] };
+    return true;
+  }
+
+  bool read_json(std::istream& is, std::vector<std::vector<Page>>& documents) {
+    auto line = std::string();
+    while (std::getline(is, line)) {
+      auto index = 0;
+      auto page_index = 0;
+      auto box = Box{ };
+      auto blank = false;
+      if (find_box(line, "\"crop_box\":", box) &&
+          find_int(line, "\"document\":", index) &&
+          find_int(line, "\"page\":", page_index)) {
+        find_bool(line, "\"blank\":", blank);
+        set_crop_box(documents, index, page_index, box, blank);
+      }
+    }
+    return !is.bad();
+  }
+
+  bool read_binary(std::istream& is, std::vector<std::vector<Page>>& documents) {
+    auto type = char{ };
+    auto index = int32_t{ };
+    auto page_index = int32_t{ };
+    while (is.read(&type, sizeof(type)) &&
+           is.read(reinterpret_cast<char*>(&index), sizeof(index)) &&
+           is.read(reinterpret_cast<char*>(&page_index), sizeof(page_index))) {
+      const auto count = (type == page_record ? page_values :
+        type == crop_box_record ? crop_box_values : 0);
+      if (!count)
+        return false;
+      double values[page_values];
+      if (!is.read(reinterpret_cast<char*>(values),
+            static_cast<std::streamsize>(count * sizeof(double))))
+        return false;
+      if (type == crop_box_record)
+        set_crop_box(documents, index, page_index,
+          { values[0], values[1], values[2], values[3] }, values[4] != 0);
+    }
+    return is.eof();
+  }
+
+  bool read_boxes(std::istream& is, std::vector<std::vector<Page>>& documents) {
+    char magic[sizeof(binary_magic)];
+    if (is.read(magic, sizeof(magic)) &&
+        std::memcmp(magic, binary_magic, sizeof(magic)) == 0)
+      return read_binary(is, documents);
+    is.clear();
+    is.seekg(0);
+    return read_json(is, documents);
+  }
+} // namespace
+
+struct BoxWriter::RecordHeader {
+  char type;
+  int32_t index;
+  int32_t page_index;
+};
+
+BoxWriter::~BoxWriter() {
+  if (m_close)
+    std::fclose(m_file);
+}
+
+bool BoxWriter::open(const std::filesystem::path& filename, BoxFormat format) {
+  m_format = format;
+  if (is_standard_stream(filename)) {
+#if defined(_WIN32)
+    if (format == BoxFormat::binary)
+      _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    m_file = stdout;
+  }
+  else {
+#if defined(_WIN32)
+    m_file = _wfopen(filename.c_str(), L"wb");
+#else
+    m_file = std::fopen(filename.c_str(), "wb");
+#endif
+    m_close = true;
+  }
+  if (!m_file)
+    return false;
+  if (format == BoxFormat::binary)
+    write(binary_magic, sizeof(binary_magic));
+  return true;
+}
+
+void BoxWriter::write(const void* data, size_t size) {
+  std::fwrite(data, 1, size, m_file);
+}
+
+// the fields are written one by one, so the records contain no padding
+void BoxWriter::write_header(const RecordHeader& header) {
+  write(&header.type, sizeof(header.type));
+  write(&header.index, sizeof(header.index));
+  write(&header.page_index, sizeof(header.page_index));
+}
+
+void BoxWriter::write_page(int index, int page_index, const Page& page) {
+  auto lock = std::lock_guard<std::mutex>(m_mutex);
+  if (m_format == BoxFormat::binary) {
+    auto values = std::vector<double>{ page.width, page.height };
+    append(values, page.bounding_box);
+    values.insert(values.end(), { page.header, page.footer });
+    append(values, page.bounding_box_no_header);
+    append(values, page.bounding_box_no_footer);
+    append(values, page.bounding_box_no_header_footer);
+    values.push_back(page.blank ? 1.0 : 0.0);
+    values.push_back(page.estimated ? 1.0 : 0.0);
+    write_header({ page_record, index, page_index });
+    write(values.data(), values.size() * sizeof(double));
+  }
+  else {
+    std::fprintf(m_file, "{\"document\": %d, \"page\": %d, "
+      "\"width\": %.3f, \"height\": %.3f, \"bounding_box\": %s, "
+      "\"header\": %.3f, \"footer\": %.3f, \"no_header\": %s, "
+      "\"no_footer\": %s, \"no_header_footer\": %s, \"blank\": %s, "
+      "\"estimated\": %s}\n",
+      index, page_index, page.width, page.height,
+      format_box(page.bounding_box).c_str(), page.header, page.footer,
+      format_box(page.bounding_box_no_header).c_str(),
+      format_box(page.bounding_box_no_footer).c_str(),
+      format_box(page.bounding_box_no_header_footer).c_str(),
+      (page.blank ? "true" : "false"), (page.estimated ? "true" : "false"));
+  }
+  // consumers can start before the document is complete
+  std::fflush(m_file);
+}
+
+void BoxWriter::write_crop_boxes(int index, const std::vector<Page>& pages) {
+  auto lock = std::lock_guard<std::mutex>(m_mutex);
+  for (auto i = 0; i < static_cast<int>(pages.size()); ++i) {
+    const auto& page = pages[static_cast<size_t>(i)];
+    const auto& box = page.bounding_box;
+    if (m_format == BoxFormat::binary) {
+      const double values[] = { box.llx, box.lly, box.urx, box.ury,
+        (page.blank ? 1.0 : 0.0) };
+      static_assert(sizeof(values) == crop_box_values * sizeof(double));
+      write_header({ crop_box_record, index, i });
+      write(values, sizeof(values));
+    }
+    else {
+      std::fprintf(m_file, "{\"document\": %d, \"page\": %d, "
+        "\"crop_box\": %s, \"blank\": %s}\n", index, i,
+        format_box(box).c_str(), (page.blank ? "true" : "false"));
+    }
+  }
+  std::fflush(m_file);
+}
+
+std::optional<std::vector<std::vector<Page>>> read_crop_boxes(
+    const std::filesystem::path& filename) {
+  auto documents = std::vector<std::vector<Page>>();
+  if (is_standard_stream(filename)) {
+    // stdin can not seek back, so it is read completely
+    const auto input = read_input(filename);
+    if (!input)
+      return { };
+    auto is = std::istringstream(std::string(input->data(), input->size()));
+    if (!read_boxes(is, documents))
+      return { };
+    return documents;
+  }
+  auto is = std::ifstream(filename, std::ios::binary);
+  if (!is.good() || !read_boxes(is, documents))
+    return { };
+  return documents;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "input.h"
+#include <cstdio>
+#include <mutex>
+#include <optional>
+
+// writes the analyzed pages as soon as they are available and the crop
+// boxes once a document was optimized. the JSON format has one object per
+// line, the binary format has fixed size records of native doubles.
+class BoxWriter {
+public:
+  BoxWriter() = default;
+  BoxWriter(const BoxWriter&) = delete;
+  BoxWriter& operator=(const BoxWriter&) = delete;
+  ~BoxWriter();
+
+  // "-" writes to stdout
+  bool open(const std::filesystem::path& filename, BoxFormat format);
+  void write_page(int index, int page_index, const Page& page);
+  void write_crop_boxes(int index, const std::vector<Page>& pages);
+
+private:
+  struct RecordHeader;
+
+  void write(const void* data, size_t size);
+  void write_header(const RecordHeader& header);
+
+  std::mutex m_mutex;
+  std::FILE* m_file{ };
+  bool m_close{ };
+  BoxFormat m_format{ };
+};
+
+// returns the pages of each document by index, with the crop box as
+// bounding box and the blank flag, nothing when the file could not be
+// read. "-" reads from stdin.
+std::optional<std::vector<std::vector<Page>>> read_crop_boxes(
+  const std::filesystem::path& filename);
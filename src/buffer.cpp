@@ -0,0 +1,105 @@
+
+#include "buffer.h"
+#include <algorithm>
+#include <cstdio>
+
+#if defined(_WIN32)
+#  include <fcntl.h>
+#  include <io.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+InputBuffer::~InputBuffer() {
+#if !defined(_WIN32)
+  if (m_mapping)
+    munmap(m_mapping, m_size);
+#endif
+}
+
+bool InputBuffer::read(int fd) {
+  auto buffer = std::vector<char>();
+  auto size = size_t{ };
+  for (;;) {
+    buffer.resize(std::max(size * 2, size_t{ 1 } << 16));
+#if defined(_WIN32)
+    const auto count = _read(fd, buffer.data() + size,
+      static_cast<unsigned int>(buffer.size() - size));
+#else
+    const auto count = ::read(fd, buffer.data() + size, buffer.size() - size);
+#endif
+    if (count < 0)
+      return false;
+    if (count == 0)
+      break;
+    size += static_cast<size_t>(count);
+  }
+  buffer.resize(size);
+  assign(m_name, std::move(buffer));
+  return true;
+}
+
+void InputBuffer::assign(std::string name, std::vector<char> data) {
+  m_name = std::move(name);
+  m_buffer = std::move(data);
+  m_data = m_buffer.data();
+  m_size = m_buffer.size();
+}
+
+bool InputBuffer::open(const std::filesystem::path& filename) {
+  m_name = filename.u8string();
+  if (is_standard_stream(filename)) {
+#if defined(_WIN32)
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    return read(fileno(stdin));
+  }
+  m_path = filename;
+
+#if defined(_WIN32)
+  const auto fd = _wopen(filename.c_str(), _O_RDONLY | _O_BINARY);
+  if (fd < 0)
+    return false;
+  const auto result = read(fd);
+  _close(fd);
+  return result;
+#else
+  const auto fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  // map regular files, other files like pipes are read
+  auto result = false;
+  struct stat status{ };
+  if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode) &&
+      status.st_size > 0) {
+    const auto size = static_cast<size_t>(status.st_size);
+    const auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      m_mapping = mapping;
+      m_data = static_cast<const char*>(mapping);
+      m_size = size;
+      result = true;
+    }
+  }
+  if (!result)
+    result = read(fd);
+  ::close(fd);
+  return result;
+#endif
+}
+
+std::shared_ptr<const InputBuffer> read_input(
+    const std::filesystem::path& filename) {
+  auto buffer = std::make_shared<InputBuffer>();
+  if (!buffer->open(filename))
+    return nullptr;
+  return buffer;
+}
+
+bool is_standard_stream(const std::filesystem::path& filename) {
+  return (filename == "-");
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+// contents of an input file, which are read once and shared by poppler
+// and QPDF. regular files are mapped into memory, "-" reads stdin.
+class InputBuffer {
+public:
+  InputBuffer() = default;
+  InputBuffer(const InputBuffer&) = delete;
+  InputBuffer& operator=(const InputBuffer&) = delete;
+  ~InputBuffer();
+
+  bool open(const std::filesystem::path& filename);
+  void assign(std::string name, std::vector<char> data);
+
+  const std::string& name() const { return m_name; }
+  // only set, when the contents were read from a file
+  const std::filesystem::path& path() const { return m_path; }
+  const char* data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+private:
+  bool read(int fd);
+
+  std::string m_name;
+  std::filesystem::path m_path;
+  const char* m_data{ };
+  size_t m_size{ };
+  std::vector<char> m_buffer;
+  void* m_mapping{ };
+};
+
+// returns nothing, when the file could not be read
+std::shared_ptr<const InputBuffer> read_input(
+  const std::filesystem::path& filename);
+
+bool is_standard_stream(const std::filesystem::path& filename);
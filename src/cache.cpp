@@ -0,0 +1,260 @@
+
+#include "cache.h"
+#include <qpdf/QPDF.hh>
+#include <qpdf/QPDFPageDocumentHelper.hh>
+#include <qpdf/QPDFPageObjectHelper.hh>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <fstream>
+#include <map>
+#include <type_traits>
+#include <utility>
+
+namespace {
+  const auto cache_magic = std::array<char, 8>{ 'P','D','F','C','R','O','P','C' };
+  const auto cache_version = uint32_t{ 5 };
+
+  static_assert(std::is_trivially_copyable_v<Page>);
+
+  struct CacheHeader {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t page_size;
+  };
+
+  CacheHeader get_cache_header() {
+    return { cache_magic, cache_version, static_cast<uint32_t>(sizeof(Page)) };
+  }
+
+  bool operator==(const CacheHeader& a, const CacheHeader& b) {
+    return a.magic == b.magic && a.version == b.version &&
+           a.page_size == b.page_size;
+  }
+
+  // FNV-1a
+  class Hash {
+  public:
+    void add(const void* data, size_t size) {
+      const auto bytes = static_cast<const unsigned char*>(data);
+      for (auto i = size_t{ }; i < size; ++i) {
+        m_value ^= bytes[i];
+        m_value *= 1099511628211ull;
+      }
+    }
+
+    template <typename T>
+    void add(const T& value) {
+      static_assert(std::is_arithmetic_v<T>);
+      add(&value, sizeof(T));
+    }
+
+    void add(const std::string& string) {
+      add(string.data(), string.size());
+      add(string.size());
+    }
+
+    uint64_t value() const { return m_value; }
+
+  private:
+    uint64_t m_value{ 14695981039346656037ull };
+  };
+
+  using ObjectHashes = std::map<QPDFObjGen, uint64_t>;
+
+  uint64_t get_object_hash(QPDFObjectHandle object, ObjectHashes& hashes);
+
+  uint64_t get_direct_object_hash(QPDFObjectHandle object, ObjectHashes& hashes) {
+    auto hash = Hash();
+    if (object.isStream()) {
+      hash.add(get_object_hash(object.getDict(), hashes));
+      const auto data = object.getRawStreamData();
+      hash.add(data->getBuffer(), data->getSize());
+    }
+    else if (object.isDictionary()) {
+      for (const auto& key : object.getKeys()) {
+        hash.add(key);
+        hash.add(get_object_hash(object.getKey(key), hashes));
+      }
+    }
+    else if (object.isArray()) {
+      for (const auto& item : object.getArrayAsVector())
+        hash.add(get_object_hash(item, hashes));
+    }
+    else {
+      hash.add(object.unparse());
+    }
+    return hash.value();
+  }
+
+  // indirect objects, like fonts shared between pages, are only hashed once
+  uint64_t get_object_hash(QPDFObjectHandle object, ObjectHashes& hashes) {
+    if (!object.isIndirect())
+      return get_direct_object_hash(object, hashes);
+
+    const auto id = object.getObjGen();
+    if (auto it = hashes.find(id); it != hashes.end())
+      return it->second;
+
+    // a reference back to an object which is being hashed
+    hashes[id] = id.getObj();
+    const auto hash = get_direct_object_hash(object, hashes);
+    hashes[id] = hash;
+    return hash;
+  }
+
+  uint64_t get_settings_hash(const Settings& settings) {
+    auto hash = Hash();
+    hash.add(cache_version);
+    hash.add(settings.resolution);
+    hash.add(settings.refine_resolution);
+    hash.add(settings.crop_header_size);
+    hash.add(settings.crop_footer_size);
+    hash.add(settings.high_quality);
+    hash.add(settings.content_bounds);
+    hash.add(settings.probe_edges);
+    hash.add(settings.ignore_noise);
+    return hash.value();
+  }
+
+  // pages without annotations, whose contents are missing or only contain
+  // whitespace, like inserted separator pages. larger streams are not
+  // decoded, they are very unlikely to be empty.
+  bool has_empty_contents(QPDFPageObjectHelper& page) {
+    const auto max_length = 64;
+    auto object = page.getObjectHandle();
+    if (object.hasKey("/Annots"))
+      return false;
+    auto contents = object.getKey("/Contents");
+    const auto streams = (contents.isArray() ? contents.getArrayAsVector() :
+      std::vector<QPDFObjectHandle>{ contents });
+    for (auto stream : streams) {
+      if (stream.isNull())
+        continue;
+      if (!stream.isStream())
+        return false;
+      auto length = stream.getDict().getKey("/Length");
+      if (!length.isInteger() || length.getIntValue() > max_length)
+        return false;
+      const auto data = stream.getStreamData();
+      const auto begin = data->getBuffer();
+      const auto end = begin + data->getSize();
+      if (std::find_if(begin, end, [](unsigned char c) {
+            return !std::isspace(c) && c != '\0'; }) != end)
+        return false;
+    }
+    return true;
+  }
+} // namespace
+
+struct PageInspector {
+  // QPDF reads from the input until it is destroyed
+  std::shared_ptr<const InputBuffer> input;
+  uint64_t settings_hash{ };
+  bool hash_pages{ };
+  bool opened{ };
+  QPDF pdf;
+  std::vector<QPDFPageObjectHelper> pages;
+  // indirect objects, which were hashed for previous pages
+  ObjectHashes object_hashes;
+  // QPDF loads objects on demand, so pages can not be inspected concurrently
+  std::mutex mutex;
+};
+
+std::shared_ptr<PageInspector> open_page_inspector(const Settings& settings,
+    std::shared_ptr<const InputBuffer> input) {
+  auto inspector = std::make_shared<PageInspector>();
+  inspector->input = std::move(input);
+  inspector->settings_hash = get_settings_hash(settings);
+  inspector->hash_pages = (!settings.cache_file.empty() ||
+    settings.dedupe_pages);
+  return inspector;
+}
+
+std::optional<PageInfo> inspect_page(PageInspector& inspector,
+    int page_index) {
+  auto lock = std::lock_guard<std::mutex>(inspector.mutex);
+  try {
+    if (!std::exchange(inspector.opened, true)) {
+      const auto& input = *inspector.input;
+      inspector.pdf.setSuppressWarnings(true);
+      inspector.pdf.processMemoryFile(input.name().c_str(),
+        input.data(), input.size());
+      inspector.pages = QPDFPageDocumentHelper(inspector.pdf).getAllPages();
+    }
+    if (page_index >= static_cast<int>(inspector.pages.size()))
+      return std::nullopt;
+
+    auto& page = inspector.pages[page_index];
+    auto info = PageInfo{ std::nullopt, has_empty_contents(page) };
+    if (!inspector.hash_pages || page.getObjectHandle().hasKey("/Annots"))
+      return info;
+
+    auto& object_hashes = inspector.object_hashes;
+    auto hash = Hash();
+    hash.add(inspector.settings_hash);
+    for (auto key : { "/Contents" })
+      hash.add(get_object_hash(page.getObjectHandle().getKey(key), object_hashes));
+    for (auto key : { "/Resources", "/MediaBox", "/CropBox", "/Rotate" })
+      hash.add(get_object_hash(page.getAttribute(key, false), object_hashes));
+    info.hash = hash.value();
+    return info;
+  }
+  catch (const std::exception&) {
+    inspector.pages.clear();
+    return std::nullopt;
+  }
+}
+
+PageCache::PageCache(std::filesystem::path filename)
+  : m_filename(std::move(filename)) {
+
+  auto is = std::ifstream(m_filename, std::ios::in | std::ios::binary);
+  auto header = CacheHeader{ };
+  if (!is.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      !(header == get_cache_header()))
+    return;
+
+  m_valid_file = true;
+  auto hash = uint64_t{ };
+  auto page = Page{ };
+  while (is.read(reinterpret_cast<char*>(&hash), sizeof(hash)) &&
+         is.read(reinterpret_cast<char*>(&page), sizeof(page)))
+    m_pages[hash] = page;
+}
+
+std::optional<Page> PageCache::find(uint64_t hash) const {
+  auto lock = std::lock_guard<std::mutex>(m_mutex);
+  if (auto it = m_pages.find(hash); it != m_pages.end())
+    return it->second;
+  return std::nullopt;
+}
+
+void PageCache::insert(uint64_t hash, const Page& page) {
+  auto lock = std::lock_guard<std::mutex>(m_mutex);
+  if (m_pages.emplace(hash, page).second)
+    m_added.emplace_back(hash, page);
+}
+
+bool PageCache::write() {
+  auto lock = std::lock_guard<std::mutex>(m_mutex);
+  if (m_added.empty())
+    return true;
+
+  // append to a valid file, otherwise replace it
+  auto os = std::ofstream(m_filename, std::ios::out | std::ios::binary |
+    (m_valid_file ? std::ios::app : std::ios::trunc));
+  if (!m_valid_file) {
+    const auto header = get_cache_header();
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  }
+  for (const auto& [hash, page] : m_added) {
+    os.write(reinterpret_cast<const char*>(&hash), sizeof(hash));
+    os.write(reinterpret_cast<const char*>(&page), sizeof(page));
+  }
+  if (!os.good())
+    return false;
+  m_valid_file = true;
+  m_added.clear();
+  return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "input.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+struct PageInfo {
+  // hash of the content, the resources and the boxes of the page, together
+  // with the settings which affect the analysis. only set, when pages are
+  // cached or deduplicated. pages with annotations are not hashed, since
+  // their appearances, like filled form fields, can differ between pages
+  // with identical contents.
+  std::optional<uint64_t> hash;
+  // the page has nothing to paint, so it does not need to be rendered
+  bool empty;
+};
+
+// document parsed for inspecting single pages before they are rendered.
+// the input is only parsed, when the first page is inspected.
+struct PageInspector;
+
+std::shared_ptr<PageInspector> open_page_inspector(const Settings& settings,
+  std::shared_ptr<const InputBuffer> input);
+
+// returns nothing when the file could not be read
+std::optional<PageInfo> inspect_page(PageInspector& inspector, int page_index);
+
+// persistent cache of analyzed pages, new pages are appended on write
+class PageCache {
+public:
+  explicit PageCache(std::filesystem::path filename);
+  PageCache(const PageCache&) = delete;
+  PageCache& operator=(const PageCache&) = delete;
+
+  std::optional<Page> find(uint64_t hash) const;
+  void insert(uint64_t hash, const Page& page);
+  bool write();
+
+private:
+  const std::filesystem::path m_filename;
+  mutable std::mutex m_mutex;
+  std::unordered_map<uint64_t, Page> m_pages;
+  std::vector<std::pair<uint64_t, Page>> m_added;
+  bool m_valid_file{ };
+};
@@ -0,0 +1,411 @@
+
+#include "content.h"
+#include <poppler/cpp/poppler-page.h>
+#include <qpdf/QPDF.hh>
+#include <qpdf/QPDFPageDocumentHelper.hh>
+#include <qpdf/QPDFPageObjectHelper.hh>
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+struct ContentDocument {
+  // QPDF reads from the input until it is destroyed
+  std::shared_ptr<const InputBuffer> input;
+  QPDF pdf;
+  std::vector<QPDFPageObjectHelper> pages;
+  // QPDF loads objects on demand, so pages can not be parsed concurrently
+  std::mutex mutex;
+};
+
+namespace {
+  const auto max_form_depth = 8;
+
+  struct Point {
+    double x;
+    double y;
+  };
+
+  struct Matrix {
+    double a{ 1 };
+    double b{ };
+    double c{ };
+    double d{ 1 };
+    double e{ };
+    double f{ };
+  };
+
+  // returns m concatenated with n, like "m cm" does with n being the CTM
+  Matrix multiply(const Matrix& m, const Matrix& n) {
+    return {
+      m.a * n.a + m.b * n.c,
+      m.a * n.b + m.b * n.d,
+      m.c * n.a + m.d * n.c,
+      m.c * n.b + m.d * n.d,
+      m.e * n.a + m.f * n.c + n.e,
+      m.e * n.b + m.f * n.d + n.f
+    };
+  }
+
+  Point transform(const Matrix& m, const Point& p) {
+    return { m.a * p.x + m.c * p.y + m.e, m.b * p.x + m.d * p.y + m.f };
+  }
+
+  enum class ColorSpace { gray, rgb, cmyk, other };
+
+  // whether painting with the color leaves a white page unchanged
+  bool is_white(ColorSpace color_space, const std::vector<double>& values) {
+    const auto all = [&](auto&& predicate) {
+      return std::all_of(values.begin(), values.end(), predicate);
+    };
+    switch (color_space) {
+      case ColorSpace::gray:
+      case ColorSpace::rgb:
+        return !values.empty() && all([](double v) { return v >= 1; });
+      case ColorSpace::cmyk:
+        return values.size() == 4 && all([](double v) { return v <= 0; });
+      case ColorSpace::other:
+        break;
+    }
+    return false;
+  }
+
+  ColorSpace get_color_space(const std::string& name) {
+    if (name == "/DeviceGray" || name == "/G")
+      return ColorSpace::gray;
+    if (name == "/DeviceRGB" || name == "/RGB")
+      return ColorSpace::rgb;
+    if (name == "/DeviceCMYK" || name == "/CMYK")
+      return ColorSpace::cmyk;
+    return ColorSpace::other;
+  }
+
+  struct GraphicsState {
+    Matrix ctm;
+    double line_width{ 1 };
+    int text_render_mode{ };
+    ColorSpace fill_color_space{ ColorSpace::gray };
+    ColorSpace stroke_color_space{ ColorSpace::gray };
+    bool fill_white{ };
+    bool stroke_white{ };
+  };
+
+  // collects the bounds of the painted paths in default user space,
+  // where top is the lower and bottom the higher y coordinate
+  class ContentParser : public QPDFObjectHandle::ParserCallbacks {
+  public:
+    explicit ContentParser(const Matrix& ctm) {
+      m_states.push_back({ });
+      m_states.back().ctm = ctm;
+    }
+
+    void parse(QPDFObjectHandle contents, QPDFObjectHandle resources) {
+      m_resources.push_back(resources);
+      QPDFObjectHandle::parseContentStream(contents, this);
+      m_resources.pop_back();
+    }
+
+    bool unsupported() const { return m_unsupported; }
+    bool has_text() const { return m_has_text; }
+    const std::vector<PageRect>& items() const { return m_items; }
+
+    void handleObject(QPDFObjectHandle object) override {
+      if (!object.isOperator()) {
+        m_operands.push_back(object);
+        return;
+      }
+      if (!m_unsupported)
+        execute(object.getOperator());
+      m_operands.clear();
+    }
+
+    void handleEOF() override {
+    }
+
+  private:
+    GraphicsState& state() { return m_states.back(); }
+
+    double number(size_t index) {
+      if (index < m_operands.size() && m_operands[index].isNumber())
+        return m_operands[index].getNumericValue();
+      return 0;
+    }
+
+    std::vector<double> numbers() {
+      auto values = std::vector<double>();
+      for (auto operand : m_operands)
+        if (operand.isNumber())
+          values.push_back(operand.getNumericValue());
+      return values;
+    }
+
+    std::string name(size_t index) {
+      if (index < m_operands.size() && m_operands[index].isName())
+        return m_operands[index].getName();
+      return { };
+    }
+
+    void add_point(double x, double y) {
+      m_path.push_back(transform(state().ctm, { x, y }));
+    }
+
+    void paint(bool fill, bool stroke) {
+      const auto& s = state();
+      const auto visible = (fill && !s.fill_white) || (stroke && !s.stroke_white);
+      if (visible && !m_path.empty()) {
+        const auto scale = std::sqrt(std::abs(s.ctm.a * s.ctm.d - s.ctm.b * s.ctm.c));
+        const auto expand = (stroke ? s.line_width * scale / 2 : 0.0);
+        auto item = PageRect{ m_path[0].x, m_path[0].y, m_path[0].x, m_path[0].y };
+        for (const auto& p : m_path) {
+          item.left = std::min(item.left, p.x);
+          item.top = std::min(item.top, p.y);
+          item.right = std::max(item.right, p.x);
+          item.bottom = std::max(item.bottom, p.y);
+        }
+        m_items.push_back({ item.left - expand, item.top - expand,
+          item.right + expand, item.bottom + expand });
+      }
+      m_path.clear();
+    }
+
+    void show_text() {
+      // invisible text, like the OCR layer of a scan, can not be told
+      // apart from visible text by the text APIs
+      const auto mode = state().text_render_mode;
+      if (mode == 3 || mode == 7)
+        m_unsupported = true;
+      m_has_text = true;
+    }
+
+    void draw_xobject(const std::string& xobject_name) {
+      auto xobjects = m_resources.back();
+      if (xobjects.isDictionary())
+        xobjects = xobjects.getKey("/XObject");
+      if (!xobjects.isDictionary())
+        return;
+      auto xobject = xobjects.getKey(xobject_name);
+      if (!xobject.isStream())
+        return;
+      auto dict = xobject.getDict();
+      auto subtype = dict.getKey("/Subtype");
+      const auto type = (subtype.isName() ? subtype.getName() : std::string());
+      if (type == "/Image") {
+        m_unsupported = true;
+        return;
+      }
+      if (type != "/Form")
+        return;
+
+      if (static_cast<int>(m_resources.size()) > max_form_depth) {
+        m_unsupported = true;
+        return;
+      }
+      auto form_state = state();
+      auto matrix = dict.getKey("/Matrix");
+      if (matrix.isArray() && matrix.getArrayNItems() == 6) {
+        auto values = std::vector<double>();
+        for (auto item : matrix.getArrayAsVector())
+          values.push_back(item.isNumber() ? item.getNumericValue() : 0);
+        form_state.ctm = multiply({ values[0], values[1], values[2],
+          values[3], values[4], values[5] }, form_state.ctm);
+      }
+      auto resources = dict.getKey("/Resources");
+      m_states.push_back(form_state);
+      m_operands.clear();
+      parse(xobject, resources.isDictionary() ? resources : m_resources.back());
+      m_states.pop_back();
+    }
+
+    void execute(const std::string& op) {
+      auto& s = state();
+      if (op == "q") {
+        m_states.push_back(s);
+      }
+      else if (op == "Q") {
+        if (m_states.size() > 1)
+          m_states.pop_back();
+      }
+      else if (op == "cm") {
+        s.ctm = multiply({ number(0), number(1), number(2),
+          number(3), number(4), number(5) }, s.ctm);
+      }
+      else if (op == "w") {
+        s.line_width = number(0);
+      }
+      else if (op == "m" || op == "l") {
+        add_point(number(0), number(1));
+      }
+      else if (op == "c") {
+        add_point(number(0), number(1));
+        add_point(number(2), number(3));
+        add_point(number(4), number(5));
+      }
+      else if (op == "v" || op == "y") {
+        add_point(number(0), number(1));
+        add_point(number(2), number(3));
+      }
+      else if (op == "re") {
+        const auto x = number(0);
+        const auto y = number(1);
+        add_point(x, y);
+        add_point(x + number(2), y);
+        add_point(x, y + number(3));
+        add_point(x + number(2), y + number(3));
+      }
+      else if (op == "S" || op == "s") {
+        paint(false, true);
+      }
+      else if (op == "f" || op == "F" || op == "f*") {
+        paint(true, false);
+      }
+      else if (op == "B" || op == "B*" || op == "b" || op == "b*") {
+        paint(true, true);
+      }
+      else if (op == "n") {
+        m_path.clear();
+      }
+      else if (op == "g" || op == "rg" || op == "k") {
+        s.fill_color_space = (op == "g" ? ColorSpace::gray :
+          op == "rg" ? ColorSpace::rgb : ColorSpace::cmyk);
+        s.fill_white = is_white(s.fill_color_space, numbers());
+      }
+      else if (op == "G" || op == "RG" || op == "K") {
+        s.stroke_color_space = (op == "G" ? ColorSpace::gray :
+          op == "RG" ? ColorSpace::rgb : ColorSpace::cmyk);
+        s.stroke_white = is_white(s.stroke_color_space, numbers());
+      }
+      else if (op == "cs") {
+        s.fill_color_space = get_color_space(name(0));
+        s.fill_white = false;
+      }
+      else if (op == "CS") {
+        s.stroke_color_space = get_color_space(name(0));
+        s.stroke_white = false;
+      }
+      else if (op == "sc" || op == "scn") {
+        s.fill_white = (name(m_operands.size() - 1).empty() &&
+          is_white(s.fill_color_space, numbers()));
+      }
+      else if (op == "SC" || op == "SCN") {
+        s.stroke_white = (name(m_operands.size() - 1).empty() &&
+          is_white(s.stroke_color_space, numbers()));
+      }
+      else if (op == "Tr") {
+        s.text_render_mode = static_cast<int>(number(0));
+      }
+      else if (op == "Tj" || op == "TJ" || op == "'" || op == "\"") {
+        show_text();
+      }
+      else if (op == "Do") {
+        draw_xobject(name(0));
+      }
+      else if (op == "BI" || op == "sh") {
+        // inline images and shadings
+        m_unsupported = true;
+      }
+      else if (op == "BDC") {
+        // optional content might be hidden
+        if (name(0) == "/OC")
+          m_unsupported = true;
+      }
+    }
+
+    std::vector<GraphicsState> m_states;
+    std::vector<QPDFObjectHandle> m_resources;
+    std::vector<QPDFObjectHandle> m_operands;
+    std::vector<Point> m_path;
+    std::vector<PageRect> m_items;
+    bool m_unsupported{ };
+    bool m_has_text{ };
+  };
+
+  bool has_annotation_appearances(QPDFObjectHandle page) {
+    auto annotations = page.getKey("/Annots");
+    if (!annotations.isArray())
+      return false;
+    for (auto annotation : annotations.getArrayAsVector())
+      if (annotation.isDictionary() && annotation.hasKey("/AP"))
+        return true;
+    return false;
+  }
+
+  // maps a rectangle of the rotated page, as the text APIs return it,
+  // to the unrotated page, like transform in image.cpp does with images
+  PageRect unrotate(const PageRect& rect, double width, double height,
+      poppler::page::orientation_enum orientation) {
+    if (orientation == poppler::page::landscape)
+      return { rect.top, height - rect.right, rect.bottom, height - rect.left };
+
+    if (orientation == poppler::page::seascape)
+      return { width - rect.bottom, rect.left, width - rect.top, rect.right };
+
+    if (orientation == poppler::page::upside_down)
+      return { width - rect.right, height - rect.bottom,
+        width - rect.left, height - rect.top };
+
+    return rect;
+  }
+} // namespace
+
+std::shared_ptr<ContentDocument> open_content_document(
+    std::shared_ptr<const InputBuffer> input) try {
+  auto document = std::make_shared<ContentDocument>();
+  document->input = input;
+  document->pdf.setSuppressWarnings(true);
+  document->pdf.processMemoryFile(input->name().c_str(),
+    input->data(), input->size());
+  document->pages = QPDFPageDocumentHelper(document->pdf).getAllPages();
+  return document;
+}
+catch (const std::exception&) {
+  return nullptr;
+}
+
+std::optional<std::vector<PageRect>> get_content_bounds(
+    ContentDocument& document, int page_index, const poppler::page& page) {
+
+  auto parser = ContentParser(Matrix{ });
+  {
+    auto lock = std::lock_guard<std::mutex>(document.mutex);
+    if (page_index >= static_cast<int>(document.pages.size()))
+      return std::nullopt;
+    try {
+      auto& page_helper = document.pages[page_index];
+      auto page_object = page_helper.getObjectHandle();
+      if (has_annotation_appearances(page_object))
+        return std::nullopt;
+      parser.parse(page_object.getKey("/Contents"),
+        page_helper.getAttribute("/Resources", false));
+    }
+    catch (const std::exception&) {
+      return std::nullopt;
+    }
+  }
+  if (parser.unsupported())
+    return std::nullopt;
+
+  // page_rect is the crop box in default user space
+  const auto crop_box = page.page_rect();
+  const auto width = crop_box.width();
+  const auto height = crop_box.height();
+
+  // text boxes are returned for the rotated page, relative to its upper-left
+  const auto text_boxes = page.text_list();
+  if (parser.has_text() == text_boxes.empty())
+    return std::nullopt;
+
+  auto items = std::vector<PageRect>();
+  for (const auto& text_box : text_boxes) {
+    const auto bbox = text_box.bbox();
+    items.push_back(unrotate({ bbox.left(), bbox.top(), bbox.right(),
+      bbox.bottom() }, width, height, page.orientation()));
+  }
+
+  for (const auto& item : parser.items())
+    items.push_back({
+      item.left - crop_box.left(),
+      crop_box.bottom() - item.bottom,
+      item.right - crop_box.left(),
+      crop_box.bottom() - item.top
+    });
+  return items;
+}
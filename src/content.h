@@ -0,0 +1,30 @@
+#pragma once
+
+#include "input.h"
+#include <memory>
+#include <optional>
+
+namespace poppler {
+  class page;
+}
+
+// rectangle in points within the unrotated page, relative to the
+// upper-left corner of the crop box, with y pointing downwards
+struct PageRect {
+  double left;
+  double top;
+  double right;
+  double bottom;
+};
+
+// document parsed for getting the bounds directly from the page contents
+struct ContentDocument;
+
+std::shared_ptr<ContentDocument> open_content_document(
+  std::shared_ptr<const InputBuffer> input);
+
+// returns the bounds of the text and paths painted on a page, or nothing
+// when the page contains content whose bounds can not be determined
+// without rendering (e.g. images) or the text APIs disagree
+std::optional<std::vector<PageRect>> get_content_bounds(
+  ContentDocument& document, int page_index, const poppler::page& page);
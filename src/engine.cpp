@@ -0,0 +1,143 @@
+
+#include "engine.h"
+#include "optimize.h"
+#include "output.h"
+#include <qpdf/QPDF.hh>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+struct Engine::Job {
+  std::shared_ptr<const InputBuffer> input;
+  bool write_output;
+  std::promise<CropResult> result;
+};
+
+struct Engine::State {
+  Settings settings;
+  std::mutex mutex;
+  std::condition_variable submitted;
+  std::deque<Job> queue;
+  // jobs which were handed to the analysis, by document index
+  std::map<int, Job> running;
+  int next_index{ };
+  bool stopping{ };
+  // set when the analysis stopped, jobs submitted afterwards fail with it
+  std::exception_ptr error;
+  std::thread thread;
+};
+
+Engine::Engine(Settings settings)
+  : m_state(std::make_unique<State>()) {
+  auto& state = *m_state;
+  state.settings = std::move(settings);
+  state.settings.timeout = 0;
+
+  // the analysis blocks waiting for the next document, until the engine
+  // is destroyed, so its threads are reused for all documents
+  state.thread = std::thread([this, &state]() {
+    auto error = std::exception_ptr();
+    try {
+      analyze_inputs(state.settings, 0,
+        [&](std::shared_ptr<const InputBuffer>& input) {
+          auto lock = std::unique_lock<std::mutex>(state.mutex);
+          state.submitted.wait(lock, [&]() {
+            return state.stopping || !state.queue.empty();
+          });
+          if (state.queue.empty())
+            return false;
+          input = state.queue.front().input;
+          state.running.emplace(state.next_index++,
+            std::move(state.queue.front()));
+          state.queue.pop_front();
+          return true;
+        },
+        [this](int index, std::vector<Page> pages,
+            std::shared_ptr<const InputBuffer> input) {
+          process(index, std::move(pages), std::move(input));
+        });
+    }
+    catch (...) {
+      error = std::current_exception();
+    }
+    fail_jobs(error);
+  });
+}
+
+Engine::~Engine() {
+  {
+    auto lock = std::lock_guard<std::mutex>(m_state->mutex);
+    m_state->stopping = true;
+  }
+  m_state->submitted.notify_all();
+  m_state->thread.join();
+}
+
+std::future<CropResult> Engine::submit(
+    std::shared_ptr<const InputBuffer> input, bool write_output) {
+  auto job = Job{ std::move(input), write_output, { } };
+  auto result = job.result.get_future();
+  {
+    auto lock = std::lock_guard<std::mutex>(m_state->mutex);
+    if (m_state->error) {
+      job.result.set_exception(m_state->error);
+      return result;
+    }
+    m_state->queue.push_back(std::move(job));
+  }
+  m_state->submitted.notify_one();
+  return result;
+}
+
+std::future<CropResult> Engine::submit(std::vector<char> data,
+    bool write_output) {
+  auto input = std::make_shared<InputBuffer>();
+  input->assign("memory", std::move(data));
+  return submit(std::move(input), write_output);
+}
+
+// called by the worker thread, which analyzed the last page of a document
+void Engine::process(int index, std::vector<Page> pages,
+    std::shared_ptr<const InputBuffer> input) {
+  auto job = [&]() {
+    auto lock = std::lock_guard<std::mutex>(m_state->mutex);
+    auto it = m_state->running.find(index);
+    auto job = std::move(it->second);
+    m_state->running.erase(it);
+    return job;
+  }();
+
+  try {
+    if (pages.empty())
+      throw std::runtime_error("reading or analyzing input failed");
+
+    auto result = CropResult{ };
+    optimize_boxes(m_state->settings, pages);
+    if (job.write_output)
+      result.output = output_pages_to_memory(m_state->settings,
+        *load_document(input), *input, pages);
+    result.pages = std::move(pages);
+    job.result.set_value(std::move(result));
+  }
+  catch (...) {
+    job.result.set_exception(std::current_exception());
+  }
+}
+
+// called when the analysis returned. jobs are only left, when it failed
+// before the engine was destroyed.
+void Engine::fail_jobs(std::exception_ptr error) {
+  if (!error)
+    error = std::make_exception_ptr(std::runtime_error("analysis stopped"));
+  auto lock = std::lock_guard<std::mutex>(m_state->mutex);
+  m_state->error = error;
+  for (auto& [index, job] : m_state->running)
+    job.result.set_exception(error);
+  m_state->running.clear();
+  for (auto& job : m_state->queue)
+    job.result.set_exception(error);
+  m_state->queue.clear();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "input.h"
+#include <future>
+#include <memory>
+#include <vector>
+
+struct CropResult {
+  // pages with the optimized crop boxes
+  std::vector<Page> pages;
+  // the rewritten PDF, when it was requested
+  std::vector<char> output;
+};
+
+// analyzes, optimizes and optionally rewrites documents in memory. the
+// worker threads and their renderers are kept until the engine is destroyed,
+// so documents can be submitted without the setup costs of each call.
+// since the analysis runs as long as the engine, the timeout is ignored.
+class Engine {
+public:
+  explicit Engine(Settings settings);
+  Engine(const Engine&) = delete;
+  Engine& operator=(const Engine&) = delete;
+  // waits until all submitted documents are complete
+  ~Engine();
+
+  // the future throws, when the document could not be read or analyzed,
+  // e.g. because it ran out of memory, or when the analysis stopped
+  std::future<CropResult> submit(std::shared_ptr<const InputBuffer> input,
+    bool write_output = false);
+  std::future<CropResult> submit(std::vector<char> data,
+    bool write_output = false);
+
+private:
+  struct Job;
+  struct State;
+
+  void process(int index, std::vector<Page> pages,
+    std::shared_ptr<const InputBuffer> input);
+  void fail_jobs(std::exception_ptr error);
+
+  std::unique_ptr<State> m_state;
+};
@@ -0,0 +1,312 @@
+
+#include "image.h"
+#include <algorithm>
+#include <array>
+
+#if !defined(NDEBUG)
+#  include <fstream>
+
+void dump_pgm(const std::string& filename, const poppler::image& image,
+    const std::vector<poppler::rect>& rectangles) {
+
+  auto os = std::ofstream(filename, std::ios::out);
+  os << "P2\n" << image.width() << " " << image.height() << "\n" << "255\n";
+  const auto bytes_per_row = image.bytes_per_row();
+  const auto data = image.const_data();
+  for (auto y = 0; y < image.height(); ++y) {
+    for (auto x = 0; x < image.width(); ++x) {
+      const auto on_rectangle = [&](){
+        for (const auto& r : rectangles) {
+          if ((x == r.left() || x == r.right()) && y >= r.top() && y <= r.bottom())
+            return true;
+          if ((y == r.bottom() || y == r.top()) && x >= r.left() && x <= r.right())
+            return true;
+        }
+        return false;
+      };
+      os << (on_rectangle() ? 127u :
+        static_cast<unsigned char>(data[y * bytes_per_row + x])) << " ";
+    }
+    os << "\n";
+  }
+}
+#endif
+
+char guess_background_color(const Image& image) {
+  const auto data = image.const_data();
+  const auto right = image.width() - 1;
+  const auto bottom = (image.height() - 1) * image.bytes_per_row();
+  return guess_background_color({
+    data[0], data[right], data[bottom], data[bottom + right]
+  });
+}
+
+char guess_background_color(const std::array<char, 4>& corners) {
+  return *std::max_element(begin(corners), end(corners),
+    [](char a, char b) {
+      return static_cast<unsigned char>(a) < static_cast<unsigned char>(b);
+    });
+}
+
+Background guess_background(std::initializer_list<const Image*> images,
+    char color, bool ignore_noise) {
+  // every 4th pixel of every 4th row is enough for the histogram
+  const auto step = 4;
+  auto histogram = Histogram{ };
+  for (const auto image : images)
+    add_histogram(histogram, to_bitmap(*image), step);
+  auto background = classify_background(histogram, color);
+  background.ignore_noise = ignore_noise;
+  return background;
+}
+
+Background guess_background(const Image& image, bool ignore_noise) {
+  return guess_background({ &image }, guess_background_color(image),
+    ignore_noise);
+}
+
+Rect get_bounds(const Image& image) {
+  return { 0, 0, image.width(), image.height() };
+}
+
+Bitmap to_bitmap(const Image& image) {
+  return { image.const_data(), image.width(), image.height(),
+    image.bytes_per_row() };
+}
+
+Bounds to_bounds(const Rect& rect) {
+  return { rect.left(), rect.top(), rect.right(), rect.bottom() };
+}
+
+Rect to_rect(const Bounds& bounds) {
+  return { bounds.left, bounds.top,
+    bounds.right - bounds.left, bounds.bottom - bounds.top };
+}
+
+bool has_background_color(const Image& image, const Rect& rect,
+    const Background& background) {
+  return has_color(to_bitmap(image), to_bounds(rect), background);
+}
+
+Rect get_used_bounds(const Image& image, const Rect& rect,
+    const Background& background) {
+  return to_rect(::get_used_bounds(to_bitmap(image), to_bounds(rect),
+    background));
+}
+
+Rect indent_bounds(const Rect& bounds, int header_size, int footer_size) {
+  return Rect{
+    bounds.x(),
+    bounds.y() + header_size,
+    bounds.width(),
+    bounds.height() - (header_size + footer_size)
+  };
+}
+
+Rect get_used_bounds(const RowProfile& profile, const Rect& rect) {
+  return to_rect(::get_used_bounds(profile, rect.top(), rect.bottom()));
+}
+
+int guess_header_size(const RowProfile& profile, const Rect& page_bounds,
+    int max_size, int image_height) {
+  max_size = std::min(max_size, image_height);
+  const auto max_space_within = max_size / 3;
+  auto header_size = 0;
+  auto iterations = uint64_t{ };
+  for (auto i = 1; i < max_size; ++i, ++iterations) {
+    const auto indented_bounds = indent_bounds(page_bounds, i, 0);
+    const auto reduced_top = find_first_used_row(profile,
+      indented_bounds.top(), indented_bounds.bottom());
+    if (indented_bounds.top() != reduced_top) {
+      if (header_size && i > header_size + max_space_within)
+        break;
+      header_size = i;
+      i = reduced_top - page_bounds.top();
+    }
+  }
+  get_work_counters().header_footer_iterations += iterations;
+  return header_size;
+}
+
+int guess_footer_size(const RowProfile& profile, const Rect& page_bounds,
+    int max_size, int image_height) {
+  max_size = std::min(max_size, image_height);
+  const auto max_space_within = max_size / 3;
+  auto footer_size = 0;
+  auto iterations = uint64_t{ };
+  for (auto i = 1; i < max_size; ++i, ++iterations) {
+    const auto indented_bounds = indent_bounds(page_bounds, 0, i);
+    const auto reduced_top = find_first_used_row(profile,
+      indented_bounds.top(), indented_bounds.bottom());
+    const auto reduced_bottom = find_last_used_row(profile,
+      reduced_top, indented_bounds.bottom()) + 1;
+    if (indented_bounds.bottom() != reduced_bottom) {
+      if (footer_size && i > footer_size + max_space_within)
+        break;
+      footer_size = i;
+      i = page_bounds.bottom() - reduced_bottom;
+    }
+  }
+  get_work_counters().header_footer_iterations += iterations;
+  return footer_size;
+}
+
+namespace {
+  bool is_rotated(poppler::page::orientation_enum orientation) {
+    return (orientation == poppler::page::landscape ||
+            orientation == poppler::page::seascape);
+  }
+
+  // copies the pixels in tiles, so the reads and the scattered
+  // writes of a rotation both stay within the cache
+  template <typename Map>
+  Image copy_tiled(const Image& image, int width, int height, Map&& map) {
+    const auto tile_size = 64;
+    auto copy = Image(width, height, Image::format_gray8);
+    const auto source = image.const_data();
+    const auto target = copy.data();
+    const auto source_bytes_per_row = image.bytes_per_row();
+    const auto target_bytes_per_row = copy.bytes_per_row();
+    const auto w = image.width();
+    const auto h = image.height();
+    for (auto ty = 0; ty < h; ty += tile_size)
+      for (auto tx = 0; tx < w; tx += tile_size)
+        for (auto y = ty; y < std::min(ty + tile_size, h); ++y)
+          for (auto x = tx; x < std::min(tx + tile_size, w); ++x) {
+            const auto [mx, my] = map(x, y);
+            target[my * target_bytes_per_row + mx] =
+              source[y * source_bytes_per_row + x];
+          }
+    return copy;
+  }
+} // namespace
+
+poppler::image transform(poppler::image&& image,
+    poppler::page::orientation_enum orientation) {
+  const auto w = image.width();
+  const auto h = image.height();
+
+  if (orientation == poppler::page::landscape)
+    return copy_tiled(image, h, w, [&](int x, int y) {
+      return std::pair(y, w - 1 - x);
+    });
+
+  if (orientation == poppler::page::seascape)
+    return copy_tiled(image, h, w, [&](int x, int y) {
+      return std::pair(h - 1 - y, x);
+    });
+
+  if (orientation == poppler::page::upside_down)
+    return copy_tiled(image, w, h, [&](int x, int y) {
+      return std::pair(w - 1 - x, h - 1 - y);
+    });
+
+  return std::move(image);
+}
+
+Rect transform(const Rect& rect, int width, int height,
+    poppler::page::orientation_enum orientation) {
+  if (orientation == poppler::page::landscape)
+    return { rect.top(), width - rect.right(), rect.height(), rect.width() };
+
+  if (orientation == poppler::page::seascape)
+    return { height - rect.bottom(), rect.left(), rect.height(), rect.width() };
+
+  if (orientation == poppler::page::upside_down)
+    return { width - rect.right(), height - rect.bottom(),
+      rect.width(), rect.height() };
+
+  return rect;
+}
+
+Rect untransform(const Rect& rect, int width, int height,
+    poppler::page::orientation_enum orientation) {
+  if (orientation == poppler::page::landscape)
+    return { height - rect.bottom(), rect.left(), rect.height(), rect.width() };
+
+  if (orientation == poppler::page::seascape)
+    return { rect.top(), width - rect.right(), rect.height(), rect.width() };
+
+  if (orientation == poppler::page::upside_down)
+    return { width - rect.right(), height - rect.bottom(),
+      rect.width(), rect.height() };
+
+  return rect;
+}
+
+int get_unrotated_width(const Image& image,
+    poppler::page::orientation_enum orientation) {
+  return (is_rotated(orientation) ? image.height() : image.width());
+}
+
+int get_unrotated_height(const Image& image,
+    poppler::page::orientation_enum orientation) {
+  return (is_rotated(orientation) ? image.width() : image.height());
+}
+
+Rect get_used_bounds(const Image& image, const Background& background,
+    poppler::page::orientation_enum orientation) {
+  const auto bounds = get_used_bounds(image, get_bounds(image), background);
+  const auto width = get_unrotated_width(image, orientation);
+  const auto height = get_unrotated_height(image, orientation);
+
+  // an empty image has bounds in the bottom-right corner,
+  // which are not mapped, so they stay the same for all orientations
+  if (bounds.width() == 1 && bounds.height() == 1 &&
+      has_background_color(image, bounds, background))
+    return { std::max(width - 1, 0), std::max(height - 1, 0), 1, 1 };
+
+  return transform(bounds, image.width(), image.height(), orientation);
+}
+
+RowProfile get_row_profile(const Image& image, const Rect& bounds,
+    const Background& background, poppler::page::orientation_enum orientation) {
+  const auto bitmap = to_bitmap(image);
+  if (orientation == poppler::page::portrait)
+    return get_row_profile(bitmap, to_bounds(bounds), background);
+
+  const auto width = get_unrotated_width(image, orientation);
+  const auto height = get_unrotated_height(image, orientation);
+  const auto rect = to_bounds(untransform(bounds, width, height, orientation));
+  const auto rows = std::max(bounds.height(), 0);
+  auto profile = RowProfile{ to_bounds(bounds),
+    std::vector<int>(rows, bounds.right()), std::vector<int>(rows, bounds.left()) };
+
+  if (orientation == poppler::page::upside_down) {
+    // rows and columns are both reversed
+    const auto rendered = get_row_profile(bitmap, rect, background);
+    for (auto i = 0; i < rows; ++i) {
+      const auto j = height - 1 - (bounds.top() + i) - rect.top;
+      if (rendered.left[j] < rect.right) {
+        profile.left[i] = width - rendered.right[j];
+        profile.right[i] = width - rendered.left[j];
+      }
+    }
+    return profile;
+  }
+
+  // the rows of the unrotated page are the columns of the image
+  const auto columns = get_column_profile(bitmap, rect, background);
+  const auto landscape = (orientation == poppler::page::landscape);
+  for (auto i = 0; i < rows; ++i) {
+    const auto y = bounds.top() + i;
+    const auto j = (landscape ? image.width() - 1 - y : y) - rect.left;
+    const auto top = columns.top[j];
+    const auto bottom = columns.bottom[j];
+    if (top < rect.bottom) {
+      profile.left[i] = (landscape ? top : image.height() - bottom);
+      profile.right[i] = (landscape ? bottom : image.height() - top);
+    }
+  }
+  return profile;
+}
+
+Box to_box(const Rect& bounds, double scale_x, double scale_y,
+    double page_height) {
+  return Box{
+    bounds.left() * scale_x,
+    page_height - bounds.bottom() * scale_y,
+    bounds.right() * scale_x,
+    page_height - bounds.top() * scale_y
+  };
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "input.h"
+#include "scan.h"
+#include <poppler/cpp/poppler-image.h>
+#include <poppler/cpp/poppler-page.h>
+#include <array>
+#include <initializer_list>
+
+using Rect = poppler::rect;
+using Image = poppler::image;
+
+char guess_background_color(const Image& image);
+char guess_background_color(const std::array<char, 4>& corners);
+// classifies the background around the color guessed from the corners,
+// using a histogram of a sample of the images
+Background guess_background(std::initializer_list<const Image*> images,
+  char color, bool ignore_noise);
+Background guess_background(const Image& image, bool ignore_noise);
+Rect get_bounds(const Image& image);
+Bitmap to_bitmap(const Image& image);
+Bounds to_bounds(const Rect& rect);
+Rect to_rect(const Bounds& bounds);
+bool has_background_color(const Image& image, const Rect& rect,
+  const Background& background);
+Rect get_used_bounds(const Image& image, const Rect& rect,
+  const Background& background);
+Rect get_used_bounds(const RowProfile& profile, const Rect& rect);
+Rect indent_bounds(const Rect& bounds, int header_size, int footer_size);
+int guess_header_size(const RowProfile& profile, const Rect& page_bounds,
+  int max_size, int image_height);
+int guess_footer_size(const RowProfile& profile, const Rect& page_bounds,
+  int max_size, int image_height);
+
+// rotates a rendered image, so its orientation matches the unrotated page.
+// the analysis does not need it, it maps the rectangles instead.
+Image transform(Image&& image, poppler::page::orientation_enum orientation);
+
+// maps a rectangle within a rendered image of size width x height
+// to the unrotated page
+Rect transform(const Rect& rect, int width, int height,
+  poppler::page::orientation_enum orientation);
+
+// maps a rectangle within the unrotated page of size width x height
+// back to the image as it was rendered
+Rect untransform(const Rect& rect, int width, int height,
+  poppler::page::orientation_enum orientation);
+
+// size of the unrotated page, of which the image was rendered
+int get_unrotated_width(const Image& image,
+  poppler::page::orientation_enum orientation);
+int get_unrotated_height(const Image& image,
+  poppler::page::orientation_enum orientation);
+
+// gets the used bounds of the image as it was rendered,
+// within the unrotated page
+Rect get_used_bounds(const Image& image, const Background& background,
+  poppler::page::orientation_enum orientation);
+
+// gets the row profile of bounds within the unrotated page,
+// directly from the image as it was rendered
+RowProfile get_row_profile(const Image& image, const Rect& bounds,
+  const Background& background, poppler::page::orientation_enum orientation);
+
+// converts bounds within an image to a box in points
+Box to_box(const Rect& bounds, double scale_x, double scale_y,
+  double page_height);
+
+#if !defined(NDEBUG)
+void dump_pgm(const std::string& filename, const Image& image,
+  const std::vector<Rect>& rectangles);
+#endif
@@ -1,259 +1,1275 @@
 
 #include "input.h"
+#include "image.h"
+#include "cache.h"
+#include "content.h"
+#include "stats.h"
 #include <poppler/cpp/poppler-document.h>
 #include <poppler/cpp/poppler-page.h>
 #include <poppler/cpp/poppler-page-renderer.h>
 #include <thread>
-#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <utility>
 #include <algorithm>
+#include <cmath>
+#include <optional>
+#include <unordered_map>
+#include <limits>
 
-#if !defined(NDEBUG)
-#  include <fstream>
-
-void dump_pgm(const std::string& filename, const poppler::image& image,
-    const std::vector<poppler::rect>& rectangles) {
-
-  auto os = std::ofstream(filename, std::ios::out);
-  os << "P2\n" << image.width() << " " << image.height() << "\n" << "255\n";
-  const auto bytes_per_row = image.bytes_per_row();
-  const auto data = image.const_data();
-  for (auto y = 0; y < image.height(); ++y) {
-    for (auto x = 0; x < image.width(); ++x) {
-      const auto on_rectangle = [&](){
-        for (const auto& r : rectangles) {
-          if ((x == r.left() || x == r.right()) && y >= r.top() && y <= r.bottom())
-            return true;
-          if ((y == r.bottom() || y == r.top()) && x >= r.left() && x <= r.right())
-            return true;
-        }
-        return false;
+#if !defined(_WIN32)
+#  include <cerrno>
+#  include <climits>
+#  include <sys/mman.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+
+namespace {
+  // refines bounds, which were found in an image rendered at a low resolution,
+  // by rendering thin strips around each edge with a higher resolution.
+  // returns the bounds in the coordinates of the high resolution image.
+  template <typename ScanStrip>
+  Rect refine_bounds(const Rect& bounds, double factor,
+      int fine_width, int fine_height, ScanStrip&& scan_strip) {
+    const auto to_fine = [&](int left, int top, int right, int bottom) {
+      const auto scale = [&](int value, int max) {
+        return std::clamp(static_cast<int>(value * factor), 0, max);
       };
-      os << (on_rectangle() ? 127u :
-        static_cast<unsigned char>(data[y * bytes_per_row + x])) << " ";
+      left = scale(left, fine_width);
+      top = scale(top, fine_height);
+      right = scale(right, fine_width);
+      bottom = scale(bottom, fine_height);
+      return Rect{ left, top, right - left, bottom - top };
+    };
+
+    // ink on the edge of the coarse bounds can be anywhere within the
+    // coarse pixel, include a neighbor for antialiasing
+    const auto l = bounds.left();
+    const auto t = bounds.top();
+    const auto r = bounds.right();
+    const auto b = bounds.bottom();
+    auto fine = to_fine(l, t, r, b);
+    auto left = fine.left();
+    auto top = fine.top();
+    auto right = fine.right();
+    auto bottom = fine.bottom();
+    const auto scan = [&](const Rect& strip) -> std::optional<Rect> {
+      if (strip.width() <= 0 || strip.height() <= 0)
+        return std::nullopt;
+      return scan_strip(strip);
+    };
+    if (const auto used = scan(to_fine(l - 1, t, l + 2, b)))
+      left = used->left();
+    if (const auto used = scan(to_fine(r - 2, t, r + 1, b)))
+      right = used->right();
+    if (const auto used = scan(to_fine(l, t - 1, r, t + 2)))
+      top = used->top();
+    if (const auto used = scan(to_fine(l, b - 2, r, b + 1)))
+      bottom = used->bottom();
+
+    if (right <= left || bottom <= top)
+      return fine;
+    return { left, top, right - left, bottom - top };
+  }
+
+  template <typename BoundsToBox>
+  void analyze_header_footer(const Settings& settings, const RowProfile& profile,
+      const Rect& page_bounds, int image_height, double scale_y,
+      BoundsToBox&& bounds_to_box, Page& result) {
+    const auto header_size = guess_header_size(profile, page_bounds,
+      static_cast<int>(settings.crop_header_size / scale_y), image_height);
+    const auto footer_size = guess_footer_size(profile, page_bounds,
+      static_cast<int>(settings.crop_footer_size / scale_y), image_height);
+    result.header = header_size * scale_y;
+    result.footer = footer_size * scale_y;
+    result.bounding_box_no_header = bounds_to_box(
+        get_used_bounds(profile, indent_bounds(page_bounds, header_size, 0)));
+    result.bounding_box_no_footer = bounds_to_box(
+        get_used_bounds(profile, indent_bounds(page_bounds, 0, footer_size)));
+    result.bounding_box_no_header_footer = bounds_to_box(
+        get_used_bounds(profile, indent_bounds(page_bounds, header_size, footer_size)));
+  }
+
+  void setup_renderer(poppler::page_renderer& renderer, const Settings& settings) {
+    renderer.set_image_format(Image::format_gray8);
+    if (settings.high_quality) {
+      renderer.set_render_hint(poppler::page_renderer::antialiasing);
+      renderer.set_render_hint(poppler::page_renderer::text_antialiasing);
+      renderer.set_render_hint(poppler::page_renderer::text_hinting);
     }
-    os << "\n";
   }
-}
+
+  // limits the memory of the images of the pages in flight
+  class MemoryBudget {
+  public:
+    explicit MemoryBudget(uint64_t size)
+      : m_size(size), m_available(size) {
+    }
+
+    uint64_t size() const { return m_size; }
+
+    void acquire(uint64_t bytes) {
+      auto lock = std::unique_lock<std::mutex>(m_mutex);
+      m_released.wait(lock, [&]() { return m_available >= bytes; });
+      m_available -= bytes;
+    }
+
+    void release(uint64_t bytes) {
+      auto lock = std::lock_guard<std::mutex>(m_mutex);
+      m_available += bytes;
+      m_released.notify_all();
+    }
+
+  private:
+    const uint64_t m_size;
+    uint64_t m_available;
+    std::mutex m_mutex;
+    std::condition_variable m_released;
+  };
+
+  struct MemoryReservation {
+    MemoryBudget& budget;
+    uint64_t bytes;
+
+    MemoryReservation(MemoryBudget& budget, uint64_t bytes)
+      : budget(budget), bytes(std::min(bytes, budget.size())) {
+      budget.acquire(this->bytes);
+    }
+    MemoryReservation(const MemoryReservation&) = delete;
+    MemoryReservation& operator=(const MemoryReservation&) = delete;
+    ~MemoryReservation() { budget.release(bytes); }
+  };
+
+  // the page as it was rendered at the base resolution
+  struct RenderedPage {
+    // size of the unrotated page
+    int width;
+    int height;
+    Background background;
+    Rect page_bounds;
+    // row profile of the page bounds, when it was requested
+    RowProfile profile;
+    // no ink was found, the page bounds are a single pixel
+    bool blank;
+  };
+
+  // the time of rendering is only measured, when statistics are collected
+  template <typename Render>
+  Image measure_render(double* render_ms, Render&& render) {
+    if (!render_ms)
+      return render();
+    auto stopwatch = Stopwatch();
+    auto image = render();
+    *render_ms += stopwatch.restart();
+    return image;
+  }
+
+  // the image is analyzed as it was rendered, the bounds are
+  // mapped to the unrotated page, instead of rotating the pixels
+  RenderedPage render_whole_page(const Settings& settings,
+      const poppler::page& page, const poppler::page_renderer& renderer,
+      bool with_profile, double* render_ms) {
+    const auto orientation = page.orientation();
+    const auto image = measure_render(render_ms, [&]() {
+      return renderer.render_page(&page,
+        settings.resolution, settings.resolution);
+    });
+
+    auto result = RenderedPage{ };
+    result.width = get_unrotated_width(image, orientation);
+    result.height = get_unrotated_height(image, orientation);
+    result.background = guess_background(image, settings.ignore_noise);
+    result.page_bounds = get_used_bounds(image, result.background,
+      orientation);
+    result.blank = (result.page_bounds.width() == 1 &&
+      result.page_bounds.height() == 1 &&
+      has_background_color(image, get_bounds(image), result.background));
+    if (with_profile)
+      result.profile = get_row_profile(image, result.page_bounds,
+        result.background, orientation);
+
+#if 0 && !defined (NDEBUG)
+    dump_pgm("page.pgm", transform(Image(image), orientation),
+      { result.page_bounds });
 #endif
+    return result;
+  }
 
-namespace {
-  using Rect = poppler::rect;
-  using Image = poppler::image;
-
-  char guess_background_color(const Image& image) {
-    const auto data = image.const_data();
-    const auto right = image.width() - 1;
-    const auto bottom = (image.height() - 1) * image.bytes_per_row();
-    const auto colors = std::array<char, 4>{
-      data[0], data[right], data[bottom], data[bottom + right]
+  // renders a rectangle of the unrotated page of size width x height
+  Image render_rect(const Settings& settings, const poppler::page& page,
+      const poppler::page_renderer& renderer, const Rect& rect,
+      int width, int height, double* render_ms) {
+    const auto rendered = untransform(rect, width, height, page.orientation());
+    return measure_render(render_ms, [&]() {
+      return renderer.render_page(&page,
+        settings.resolution, settings.resolution,
+        rendered.x(), rendered.y(), rendered.width(), rendered.height());
+    });
+  }
+
+  // gets a pixel of the unrotated page from a rendered rectangle of it
+  char get_unrotated_pixel(const Image& image, int x, int y,
+      poppler::page::orientation_enum orientation) {
+    const auto width = get_unrotated_width(image, orientation);
+    const auto height = get_unrotated_height(image, orientation);
+    const auto p = untransform(Rect{ std::clamp(x, 0, width - 1),
+      std::clamp(y, 0, height - 1), 1, 1 }, width, height, orientation);
+    return image.const_data()[p.y() * image.bytes_per_row() + p.x()];
+  }
+
+  // the corners of the page are in the rendered rectangles
+  // of the first and the last rows
+  char guess_background_color(const Image& first, const Image& last,
+      poppler::page::orientation_enum orientation) {
+    const auto width = get_unrotated_width(first, orientation);
+    const auto last_height = get_unrotated_height(last, orientation);
+    return ::guess_background_color({
+      get_unrotated_pixel(first, 0, 0, orientation),
+      get_unrotated_pixel(first, width - 1, 0, orientation),
+      get_unrotated_pixel(last, 0, last_height - 1, orientation),
+      get_unrotated_pixel(last, width - 1, last_height - 1, orientation) });
+  }
+
+  // copies the row profile of a rendered band of rows to
+  // the profile of the whole unrotated page
+  void add_band_profile(RowProfile& profile, const Image& image, int top,
+      const Background& background,
+      poppler::page::orientation_enum orientation) {
+    if (!image.is_valid())
+      return;
+    const auto width = profile.rect.right;
+    const auto band_width = get_unrotated_width(image, orientation);
+    const auto rows = std::min(get_unrotated_height(image, orientation),
+      profile.rect.bottom - top);
+    const auto band = get_row_profile(image, Rect{ 0, 0, band_width, rows },
+      background, orientation);
+    for (auto i = 0; i < rows; ++i)
+      if (band.left[i] < band_width) {
+        profile.left[top + i] = std::min(band.left[i], width - 1);
+        profile.right[top + i] = std::min(band.right[i], width);
+      }
+  }
+
+  RowProfile make_empty_profile(int width, int height) {
+    return { { 0, 0, width, height },
+      std::vector<int>(height, width), std::vector<int>(height, 0) };
+  }
+
+  // sets the page bounds from a profile of the whole unrotated page.
+  // there is no ink outside the bounds, its rows only need to be restricted.
+  void set_page_profile(RenderedPage& result, const RowProfile& profile) {
+    const auto width = profile.rect.right;
+    const auto bounds = get_used_bounds(profile, 0, profile.rect.bottom);
+    result.page_bounds = to_rect(bounds);
+    result.blank = std::none_of(profile.left.begin(), profile.left.end(),
+      [&](int left) { return left < width; });
+    result.profile = RowProfile{ bounds,
+      std::vector<int>(bounds.bottom - bounds.top, bounds.right),
+      std::vector<int>(bounds.bottom - bounds.top, bounds.left) };
+    for (auto y = bounds.top; y < bounds.bottom; ++y)
+      if (profile.left[y] < width) {
+        result.profile.left[y - bounds.top] = profile.left[y];
+        result.profile.right[y - bounds.top] = profile.right[y];
+      }
+  }
+
+  // renders a page, which does not fit into the memory budget, in bands of
+  // rows of the unrotated page. the row profiles of the bands are merged.
+  RenderedPage render_page_in_bands(const Settings& settings,
+      const poppler::page& page, const poppler::page_renderer& renderer,
+      int width, int height, int band_height, double* render_ms) {
+    const auto orientation = page.orientation();
+    const auto render_band = [&](int top) {
+      return render_rect(settings, page, renderer,
+        Rect{ 0, top, width, std::min(band_height, height - top) },
+        width, height, render_ms);
     };
-    return *std::max_element(begin(colors), end(colors),
-      [](char a, char b) {
-        return static_cast<unsigned char>(a) < static_cast<unsigned char>(b);
-      });
+
+    const auto last_top = (height - 1) / band_height * band_height;
+    auto first = std::optional<Image>(render_band(0));
+    auto last = std::optional<Image>(render_band(last_top));
+    if (!first->is_valid() || !last->is_valid())
+      return render_whole_page(settings, page, renderer, true, render_ms);
+
+    auto result = RenderedPage{ };
+    result.width = width;
+    result.height = height;
+    result.background = guess_background({ &*first, &*last },
+      guess_background_color(*first, *last, orientation), settings.ignore_noise);
+
+    auto profile = make_empty_profile(width, height);
+    for (auto top = 0; top < height; top += band_height) {
+      const auto image = (top == 0 ? *std::exchange(first, std::nullopt) :
+        top == last_top ? *std::exchange(last, std::nullopt) : render_band(top));
+      add_band_profile(profile, image, top, result.background, orientation);
+    }
+    set_page_profile(result, profile);
+    return result;
   }
 
-  Rect get_bounds(const Image& image) {
-    return { 0, 0, image.width(), image.height() };
+  enum class Edge { top, bottom, left, right };
+
+  // the first strips of the top and the bottom edge are a 16th of the page
+  int get_first_strip_rows(int height, int max_rows) {
+    return std::min(std::max(height / 16, 1), max_rows);
   }
 
-  Rect get_used_bounds(const Image& image, const Rect& rect) {
-    const auto bytes_per_row = image.bytes_per_row();
-    const auto data = image.const_data();
-    const auto background_color = guess_background_color(image);
-    const auto rect_has_background_color = [&](const Rect& rect) {
-      for (auto y = rect.top(); y < rect.bottom(); ++y)
-        for (auto x = rect.left(); x < rect.right(); ++x)
-          if (data[y * bytes_per_row + x] != background_color)
-            return false;
-      return true;
+  // finds the bounds by rendering strips inward from each edge, until the
+  // first ink is found, so the interior of the page is never rendered.
+  // the header and footer are searched in bands of rows of their own.
+  // no rendered rectangle is larger than max_rows rows of the page. returns
+  // nothing, when the page needs to be rendered as a whole.
+  std::optional<RenderedPage> probe_page_edges(const Settings& settings,
+      const poppler::page& page, const poppler::page_renderer& renderer,
+      int width, int height, int max_rows, bool with_profile,
+      double* render_ms) {
+    const auto orientation = page.orientation();
+    const auto render = [&](const Rect& rect) {
+      return render_rect(settings, page, renderer, rect, width, height,
+        render_ms);
     };
+    const auto max_pixels = int64_t{ width } * max_rows;
 
-    const auto x1 = rect.x() + rect.width() - 1;
-    const auto y1 = rect.y() + rect.height() - 1;
+    // strips start at a 16th of the page and double in size, the first
+    // of the top and the bottom edge also provide the corners
+    const auto strip_height = get_first_strip_rows(height, max_rows);
+    const auto strip_width = std::max(width / 16, 1);
+    auto cached = std::vector<std::pair<Rect, Image>>();
+    cached.emplace_back(Rect{ 0, 0, width, strip_height },
+      render({ 0, 0, width, strip_height }));
+    cached.emplace_back(Rect{ 0, height - strip_height, width, strip_height },
+      render({ 0, height - strip_height, width, strip_height }));
+    if (!cached[0].second.is_valid() || !cached[1].second.is_valid())
+      return std::nullopt;
 
-    auto min_y = rect.y();
-    for (; min_y < y1; ++min_y)
-      if (!rect_has_background_color({ rect.x(), min_y, rect.width(), 1 }))
-        break;
+    auto result = RenderedPage{ };
+    result.width = width;
+    result.height = height;
+    result.background = guess_background(
+      { &cached[0].second, &cached[1].second }, guess_background_color(
+        cached[0].second, cached[1].second, orientation), settings.ignore_noise);
+    const auto background = result.background;
 
-    auto max_y = y1;
-    for (; max_y > min_y; --max_y)
-      if (!rect_has_background_color({ rect.x(), max_y, rect.width(), 1 }))
-        break;
+    // returns the used bounds within the rectangle, or nothing when it is empty
+    const auto scan = [&](const Rect& rect) -> std::optional<Rect> {
+      const auto it = std::find_if(cached.begin(), cached.end(),
+        [&](const auto& c) {
+          return (c.first.x() == rect.x() && c.first.y() == rect.y() &&
+                  c.first.width() == rect.width() &&
+                  c.first.height() == rect.height());
+        });
+      const auto image = (it != cached.end() ? it->second : render(rect));
+      if (!image.is_valid() || has_background_color(image,
+            get_bounds(image), background))
+        return std::nullopt;
+      const auto used = get_used_bounds(image, background, orientation);
+      return Rect{ rect.x() + used.x(), rect.y() + used.y(),
+        used.width(), used.height() };
+    };
 
-    auto min_x = rect.x();
-    for (; min_x < x1; ++min_x)
-      if (!rect_has_background_color({ min_x, min_y, 1, max_y - min_y }))
-        break;
+    // returns the used bounds of the first strip with ink, the side of
+    // the bounds facing the edge is the one of the whole region
+    const auto probe = [&](const Rect& region, Edge edge) -> std::optional<Rect> {
+      const auto vertical = (edge == Edge::top || edge == Edge::bottom);
+      const auto extent = (vertical ? region.height() : region.width());
+      const auto across = std::max(vertical ? region.width() : region.height(), 1);
+      const auto max_size = static_cast<int>(std::clamp<int64_t>(
+        max_pixels / across, 1, extent));
+      auto size = std::min(vertical ? strip_height : strip_width, max_size);
+      for (auto offset = 0; offset < extent;
+           offset += size, size = std::min(size * 2, max_size)) {
+        const auto s = std::min(size, extent - offset);
+        const auto strip =
+          edge == Edge::top ? Rect{ region.x(), region.y() + offset, region.width(), s } :
+          edge == Edge::bottom ? Rect{ region.x(), region.bottom() - offset - s, region.width(), s } :
+          edge == Edge::left ? Rect{ region.x() + offset, region.y(), s, region.height() } :
+                               Rect{ region.right() - offset - s, region.y(), s, region.height() };
+        if (const auto used = scan(strip))
+          return used;
+      }
+      return std::nullopt;
+    };
 
-    auto max_x = x1;
-    for (; max_x > min_x; --max_x)
-      if (!rect_has_background_color({ max_x, min_y, 1, max_y - min_y }))
-        break;
+    // returns the first and last row with ink and the extent of the ink in them.
+    // strips are classified on their own, so ink found in one strip can be
+    // missing in another one. the page is then rendered as a whole.
+    auto inconsistent = false;
+    const auto probe_rows = [&](int top, int bottom) -> std::optional<Bounds> {
+      const auto first = probe({ 0, top, width, bottom - top }, Edge::top);
+      if (!first)
+        return std::nullopt;
+      top = first->top();
+      const auto last = probe({ 0, top, width, bottom - top }, Edge::bottom);
+      if (!last) {
+        inconsistent = true;
+        return std::nullopt;
+      }
+      bottom = last->bottom();
+      const auto rows = Rect{ 0, top, width, bottom - top };
+      const auto left = probe(rows, Edge::left);
+      const auto right = probe(rows, Edge::right);
+      if (!left || !right) {
+        inconsistent = true;
+        return std::nullopt;
+      }
+      return Bounds{ left->left(), top, right->right(), bottom };
+    };
+
+    auto profile = make_empty_profile(width, height);
+    const auto add_rows = [&](const Bounds& rows) {
+      for (auto y = rows.top; y < rows.bottom; ++y) {
+        profile.left[y] = std::min(profile.left[y], rows.left);
+        profile.right[y] = std::max(profile.right[y], rows.right);
+      }
+    };
 
-    return { min_x, min_y, max_x - min_x + 1, max_y - min_y + 1 };
+    const auto page_rows = probe_rows(0, height);
+    if (inconsistent)
+      return std::nullopt;
+    if (!page_rows) {
+      set_page_profile(result, profile);
+      return result;
+    }
+    if (!with_profile) {
+      result.page_bounds = to_rect(*page_rows);
+      return result;
+    }
+
+    // the header and footer bands get a real profile. rows in between are
+    // only known to be within the extent of their ink, which is exact for
+    // the bounds, since the header and footer never reach beyond the bands.
+    const auto scale_y = page.page_rect().height() / height;
+    const auto top = page_rows->top;
+    const auto bottom = page_rows->bottom;
+    const auto header_rows = std::clamp(static_cast<int>(
+      settings.crop_header_size / scale_y), 0, bottom - top);
+    const auto footer_rows = std::clamp(static_cast<int>(
+      settings.crop_footer_size / scale_y), 0, bottom - top);
+    const auto render_band = [&](int band_top, int band_bottom) {
+      for (auto y = band_top; y < band_bottom; y += max_rows)
+        add_band_profile(profile, render({ 0, y, width,
+          std::min(max_rows, band_bottom - y) }), y, background, orientation);
+    };
+    if (top + header_rows >= bottom - footer_rows) {
+      render_band(top, bottom);
+    }
+    else {
+      render_band(top, top + header_rows);
+      render_band(bottom - footer_rows, bottom);
+      if (const auto rows = probe_rows(top + header_rows, bottom - footer_rows))
+        add_rows(*rows);
+      if (inconsistent)
+        return std::nullopt;
+    }
+    set_page_profile(result, profile);
+    return result;
   }
 
-  Rect indent_bounds(const Rect& bounds, int header_size, int footer_size) {
-    return Rect{
-      bounds.x(),
-      bounds.y() + header_size,
-      bounds.width(),
-      bounds.height() - (header_size + footer_size)
+  // the memory poppler needs for rendering a page, it renders into
+  // a bitmap of its own, which is then copied to the image
+  uint64_t get_render_memory(int width, int height) {
+    return uint64_t{ 2 } * width * height;
+  }
+
+  RenderedPage render_page(const Settings& settings,
+      const poppler::page& page, const poppler::page_renderer& renderer,
+      bool with_profile, MemoryBudget* budget, double* render_ms) {
+    if (!budget && !settings.probe_edges)
+      return render_whole_page(settings, page, renderer, with_profile, render_ms);
+
+    const auto scale = settings.resolution / 72;
+    const auto rect = page.page_rect();
+    const auto width = std::max(static_cast<int>(std::ceil(rect.width() * scale)), 1);
+    const auto height = std::max(static_cast<int>(std::ceil(rect.height() * scale)), 1);
+    const auto memory = get_render_memory(width, height);
+
+    // up to three bands are kept at once, when the page does not fit
+    const auto fits = (!budget || memory <= budget->size());
+    const auto band_height = (fits ? height : static_cast<int>(
+      std::clamp<uint64_t>(budget->size() / 3 / get_render_memory(width, 1),
+        1, height)));
+
+    // the two first strips and the current one are kept at once. with a
+    // budget, they are limited to half of the page, so only that is
+    // reserved. when the strips disagree, the reservation is released,
+    // before the page is rendered as a whole or in bands.
+    if (settings.probe_edges) {
+      const auto max_rows = (budget && fits ?
+        std::max((height + 1) / 2, 1) : band_height);
+      auto reservation = std::optional<MemoryReservation>();
+      if (budget)
+        reservation.emplace(*budget, get_render_memory(width,
+          2 * get_first_strip_rows(height, max_rows) + max_rows));
+      if (auto result = probe_page_edges(settings, page, renderer,
+            width, height, max_rows, with_profile, render_ms))
+        return std::move(*result);
+    }
+    if (fits) {
+      auto reservation = std::optional<MemoryReservation>();
+      if (budget)
+        reservation.emplace(*budget, memory);
+      return render_whole_page(settings, page, renderer, with_profile, render_ms);
+    }
+
+    const auto reservation = MemoryReservation(*budget,
+      3 * get_render_memory(width, band_height));
+    return render_page_in_bands(settings, page, renderer,
+      width, height, band_height, render_ms);
+  }
+
+  // the bounding box of a blank page is the whole page
+  Page make_blank_page(const poppler::page& page) {
+    const auto rect = page.page_rect();
+    const auto box = Box{ 0, 0, rect.width(), rect.height() };
+    auto result = Page{ };
+    result.bounding_box = box;
+    result.bounding_box_no_header = box;
+    result.bounding_box_no_footer = box;
+    result.bounding_box_no_header_footer = box;
+    result.blank = true;
+    return result;
+  }
+
+  Page analyze_page(const Settings& settings, const poppler::page& page,
+      const poppler::page_renderer& renderer, MemoryBudget* budget,
+      double* render_ms) {
+    const auto orientation = page.orientation();
+    const auto with_profile =
+      (settings.crop_header_size || settings.crop_footer_size);
+    const auto rendered = render_page(settings, page, renderer,
+      with_profile, budget, render_ms);
+    if (rendered.blank)
+      return make_blank_page(page);
+    const auto width = rendered.width;
+    const auto height = rendered.height;
+    const auto background = rendered.background;
+    const auto& page_bounds = rendered.page_bounds;
+
+    const auto page_width = page.page_rect().width();
+    const auto page_height = page.page_rect().height();
+    const auto scale_x = page_width / width;
+    const auto scale_y = page_height / height;
+
+    const auto refine = (settings.refine_resolution > settings.resolution);
+    const auto factor = settings.refine_resolution / settings.resolution;
+    const auto fine_width = static_cast<int>(width * factor);
+    const auto fine_height = static_cast<int>(height * factor);
+
+    // returns the used bounds within the strip in fine coordinates
+    const auto scan_strip = [&](const Rect& strip) -> std::optional<Rect> {
+      const auto rect = untransform(strip, fine_width, fine_height, orientation);
+      const auto strip_image = measure_render(render_ms, [&]() {
+        return renderer.render_page(&page,
+          settings.refine_resolution, settings.refine_resolution,
+          rect.x(), rect.y(), rect.width(), rect.height());
+      });
+      if (!strip_image.is_valid() || has_background_color(strip_image,
+            get_bounds(strip_image), background))
+        return std::nullopt;
+      const auto used = get_used_bounds(strip_image, background,
+        orientation);
+      return Rect{ strip.x() + used.x(), strip.y() + used.y(),
+        used.width(), used.height() };
+    };
+
+    const auto bounds_to_box = [&](const Rect& bounds) {
+      if (!refine)
+        return to_box(bounds, scale_x, scale_y, page_height);
+      return to_box(refine_bounds(bounds, factor, fine_width, fine_height,
+          scan_strip),
+        page_width / fine_width, page_height / fine_height, page_height);
+    };
+
+    auto result = Page{ };
+    result.bounding_box = bounds_to_box(page_bounds);
+
+    // rows were scanned once, header and footer are found using the profile
+    if (with_profile)
+      analyze_header_footer(settings, rendered.profile, page_bounds, height,
+        scale_y, bounds_to_box, result);
+    return result;
+  }
+
+  // gets the bounds from the page contents, instead of rendering it
+  std::optional<Page> analyze_page_content(const Settings& settings,
+      const poppler::page& page, ContentDocument& document, int page_index) {
+    const auto items = get_content_bounds(document, page_index, page);
+    if (!items)
+      return std::nullopt;
+
+    // use the same row profile as for a rendered image
+    const auto page_width = page.page_rect().width();
+    const auto page_height = page.page_rect().height();
+    const auto scale = settings.resolution / 72;
+    const auto width = std::max(static_cast<int>(std::ceil(page_width * scale)), 1);
+    const auto height = std::max(static_cast<int>(std::ceil(page_height * scale)), 1);
+    const auto scale_x = page_width / width;
+    const auto scale_y = page_height / height;
+
+    auto clipped_items = std::vector<PageRect>();
+    auto item_bounds = std::vector<Bounds>();
+    for (const auto& item : *items) {
+      const auto clipped = PageRect{
+        std::max(item.left, 0.0), std::max(item.top, 0.0),
+        std::min(item.right, page_width), std::min(item.bottom, page_height)
+      };
+      if (clipped.left >= clipped.right || clipped.top >= clipped.bottom)
+        continue;
+      clipped_items.push_back(clipped);
+      item_bounds.push_back({
+        static_cast<int>(std::floor(clipped.left / scale_x)),
+        static_cast<int>(std::floor(clipped.top / scale_y)),
+        static_cast<int>(std::ceil(clipped.right / scale_x)),
+        static_cast<int>(std::ceil(clipped.bottom / scale_y))
+      });
+    }
+    if (item_bounds.empty())
+      return make_blank_page(page);
+    const auto profile = get_row_profile({ 0, 0, width, height }, item_bounds);
+    const auto page_bounds = to_rect(get_used_bounds(profile, 0, height));
+
+    // the boxes are the exact extents of the items within the bounds
+    const auto bounds_to_box = [&](const Rect& bounds) {
+      auto box = std::optional<PageRect>();
+      for (auto i = 0u; i < item_bounds.size(); ++i) {
+        const auto& b = item_bounds[i];
+        if (b.right <= bounds.left() || b.left >= bounds.right() ||
+            b.bottom <= bounds.top() || b.top >= bounds.bottom())
+          continue;
+        const auto& item = clipped_items[i];
+        if (!box)
+          box = item;
+        box->left = std::min(box->left, item.left);
+        box->top = std::min(box->top, item.top);
+        box->right = std::max(box->right, item.right);
+        box->bottom = std::max(box->bottom, item.bottom);
+      }
+      if (!box)
+        return to_box(bounds, scale_x, scale_y, page_height);
+      return Box{ box->left, page_height - box->bottom,
+        box->right, page_height - box->top };
     };
+
+    auto result = Page{ };
+    result.bounding_box = bounds_to_box(page_bounds);
+    if (settings.crop_header_size || settings.crop_footer_size)
+      analyze_header_footer(settings, profile, page_bounds, height,
+        scale_y, bounds_to_box, result);
+    return result;
+  }
+
+  void set_page_size(Page& result, const poppler::page& page) {
+    const auto rect = page.page_rect();
+    const auto orientation = page.orientation();
+    const auto rotated = (orientation == poppler::page::landscape ||
+                          orientation == poppler::page::seascape);
+    result.width = (rotated ? rect.height() : rect.width());
+    result.height = (rotated ? rect.width() : rect.height());
   }
 
-  int guess_header_size(const Image& image, const Rect& page_bounds, int max_size) {
-    max_size = std::min(max_size, image.height());
-    const auto max_space_within = max_size / 3;
-    auto header_size = 0;
-    for (auto i = 1; i < max_size; ++i) {
-      const auto indented_bounds = indent_bounds(page_bounds, i, 0);
-      const auto reduced_bounds = get_used_bounds(image, indented_bounds);
-      if (indented_bounds.top() != reduced_bounds.top()) {
-        if (header_size && i > header_size + max_space_within)
-          break;
-        header_size = i;
-        i = reduced_bounds.top() - page_bounds.top();
+  // identical pages get the result of the first one, which is analyzed
+  struct PageGroup {
+    int first;
+    bool done;
+    std::vector<int> waiting;
+  };
+
+  struct Document {
+    int index;
+    // poppler reads from the input until the document is destroyed
+    std::shared_ptr<const InputBuffer> input;
+    std::unique_ptr<poppler::document> document;
+    std::vector<Page> pages;
+    std::shared_ptr<ContentDocument> content;
+    // only set, when pages are looked up in the cache, deduplicated or
+    // checked for empty contents
+    std::shared_ptr<PageInspector> inspector;
+    std::vector<std::optional<uint64_t>> hashes;
+    std::unordered_map<uint64_t, PageGroup> groups;
+    std::mutex groups_mutex;
+    // indices of the pages, which still need to be handed out
+    std::vector<int> pending_pages;
+    // pages outside of the sample, empty when all pages are in it
+    std::vector<bool> estimated;
+    int next_pending{ };
+    std::atomic<int> pages_left{ };
+    // a page could not be analyzed, the document is reported as not readable
+    std::atomic<bool> failed{ };
+  };
+
+  std::unique_ptr<poppler::document> open_poppler_document(
+      const InputBuffer& input) {
+    // poppler takes the size of raw data as int, larger files are
+    // opened again by poppler, stdin and memory inputs can not be read
+    if (input.size() > static_cast<size_t>(std::numeric_limits<int>::max())) {
+      auto error = std::error_code{ };
+      if (input.path().empty() ||
+          !std::filesystem::is_regular_file(input.path(), error))
+        return nullptr;
+      return std::unique_ptr<poppler::document>(
+        poppler::document::load_from_file(input.path().u8string()));
+    }
+    return std::unique_ptr<poppler::document>(
+      poppler::document::load_from_raw_data(input.data(),
+        static_cast<int>(input.size())));
+  }
+
+  // selects about as many odd as even pages, which are spread evenly
+  // over the document, so the sample does not depend on the thread count
+  std::vector<bool> select_sample(int page_count, int sample_count) {
+    auto estimated = std::vector<bool>(page_count, true);
+    for (auto parity = 0; parity < 2; ++parity) {
+      const auto pages = (page_count - parity + 1) / 2;
+      const auto count = std::min((sample_count + 1 - parity) / 2, pages);
+      for (auto j = 0; j < count; ++j)
+        estimated[parity + 2 * ((2 * j + 1) * pages / (2 * count))] = false;
+    }
+    return estimated;
+  }
+
+  // pages outside of the sample are only estimated by probing the edges
+  // at a lower resolution
+  Settings get_estimate_settings(Settings settings) {
+    settings.resolution = std::max(settings.resolution / 2, 18.0);
+    settings.refine_resolution = 0;
+    settings.probe_edges = true;
+    return settings;
+  }
+
+  std::shared_ptr<Document> open_document(const Settings& settings,
+      int index, std::shared_ptr<const InputBuffer> input) {
+    if (!input)
+      return nullptr;
+    auto document = open_poppler_document(*input);
+    if (!document)
+      return nullptr;
+    const auto page_count = document->pages();
+    if (page_count <= 0)
+      return nullptr;
+
+    auto result = std::make_shared<Document>();
+    result->index = index;
+    result->input = input;
+    result->document = std::move(document);
+    result->pages.resize(page_count);
+
+    if (settings.content_bounds)
+      result->content = open_content_document(input);
+
+    if (settings.sample_pages > 0 && page_count > settings.sample_pages)
+      result->estimated = select_sample(page_count, settings.sample_pages);
+
+    // pages are only inspected before rendering, when they are cached,
+    // identical pages, like repeated slides, should be analyzed once or
+    // blank pages, like inserted separator pages, are handled
+    if (!settings.cache_file.empty() || settings.dedupe_pages ||
+        settings.blank_pages != BlankPages::keep) {
+      result->inspector = open_page_inspector(settings, input);
+      result->hashes.resize(page_count);
+    }
+
+    for (auto i = 0; i < page_count; ++i)
+      result->pending_pages.push_back(i);
+    result->pages_left = page_count;
+    return result;
+  }
+
+  int get_pending_count(const Document& document) {
+    return static_cast<int>(document.pending_pages.size());
+  }
+
+  enum class PageState { analyze, known, waiting };
+
+  // looks up a page in the cache and checks whether it is empty or identical
+  // to a page which was already analyzed, so it does not need to be rendered.
+  // a page identical to one which is being analyzed waits for its result.
+  PageState inspect_document_page(const Settings& settings,
+      Document& document, int page_index, PageCache* cache, Stats* stats) {
+    if (!document.inspector)
+      return PageState::analyze;
+    const auto info = inspect_page(*document.inspector, page_index);
+    if (!info)
+      return PageState::analyze;
+
+    const auto& hash = document.hashes[page_index] = info->hash;
+    if (hash && cache)
+      if (auto page = cache->find(*hash)) {
+        document.pages[page_index] = *page;
+        return PageState::known;
+      }
+
+    if (info->empty)
+      if (const auto page = std::unique_ptr<poppler::page>(
+            document.document->create_page(page_index))) {
+        document.pages[page_index] = make_blank_page(*page);
+        set_page_size(document.pages[page_index], *page);
+        return PageState::known;
       }
+
+    if (!hash || !settings.dedupe_pages)
+      return PageState::analyze;
+
+    auto lock = std::lock_guard<std::mutex>(document.groups_mutex);
+    auto& group = document.groups.try_emplace(*hash,
+      PageGroup{ page_index, false, { } }).first->second;
+    if (group.first == page_index)
+      return PageState::analyze;
+    if (!group.done) {
+      group.waiting.push_back(page_index);
+      return PageState::waiting;
     }
-    return header_size;
-  }
-
-  int guess_footer_size(const Image& image, const Rect& page_bounds, int max_size) {
-    max_size = std::min(max_size, image.height());
-    const auto max_space_within = max_size / 3;
-    auto footer_size = 0;
-    for (auto i = 1; i < max_size; ++i) {
-      const auto indented_bounds = indent_bounds(page_bounds, 0, i);
-      const auto reduced_bounds = get_used_bounds(image, indented_bounds);
-      if (indented_bounds.bottom() != reduced_bounds.bottom()) {
-        if (footer_size && i > footer_size + max_space_within)
-          break;
-        footer_size = i;
-        i = page_bounds.bottom() - reduced_bounds.bottom();
+    document.pages[page_index] = document.pages[group.first];
+    if (stats)
+      stats->add_saved_renders(1);
+    return PageState::known;
+  }
+
+  // reports a page and copies its result to the identical pages, which were
+  // waiting for it. returns whether it was the last page of the document.
+  bool complete_page(Document& document, int page_index,
+      const PageCallback& on_page_done, Progress& progress, Stats* stats) {
+    auto waiting = std::vector<int>();
+    if (!document.hashes.empty() && document.hashes[page_index]) {
+      auto lock = std::lock_guard<std::mutex>(document.groups_mutex);
+      const auto it = document.groups.find(*document.hashes[page_index]);
+      if (it != document.groups.end() && it->second.first == page_index) {
+        it->second.done = true;
+        waiting = std::move(it->second.waiting);
       }
     }
-    return footer_size;
+    if (stats && !waiting.empty())
+      stats->add_saved_renders(static_cast<int>(waiting.size()));
+
+    const auto report = [&](int i) {
+      progress.pages_done.fetch_add(1, std::memory_order_relaxed);
+      if (on_page_done)
+        on_page_done(document.index, i, document.pages[i]);
+    };
+    report(page_index);
+    for (auto i : waiting) {
+      document.pages[i] = document.pages[page_index];
+      report(i);
+    }
+    const auto count = 1 + static_cast<int>(waiting.size());
+    return (document.pages_left.fetch_sub(count) == count);
   }
 
-  poppler::image transform(poppler::image&& image,
-      poppler::page::orientation_enum orientation) {
+  using Deadline = std::chrono::steady_clock::time_point;
+
+  Deadline get_deadline(const Settings& settings) {
+    if (settings.timeout <= 0)
+      return Deadline::max();
+    return std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(settings.timeout));
+  }
 
-    const auto w = image.width();
-    const auto h = image.height();
-    const auto bytes_per_row = image.bytes_per_row();
+  // an elapsed timeout cancels the analysis like an interrupt
+  bool is_cancelled(Progress& progress, const Deadline& deadline) {
+    if (!progress.cancelled.load(std::memory_order_relaxed) &&
+        std::chrono::steady_clock::now() >= deadline)
+      progress.cancelled = true;
+    return progress.cancelled.load(std::memory_order_relaxed);
+  }
 
-    if (orientation == poppler::page::landscape) {
-      auto rotated = poppler::image(h, w, poppler::image::format_gray8);
-      const auto rotated_bytes_per_row = rotated.bytes_per_row();
-      for (auto y = 0; y < h; ++y)
-        for (auto x = 0; x < w; ++x)
-          rotated.data()[x * rotated_bytes_per_row + y] =
-            image.const_data()[y * bytes_per_row + (w - 1 - x)];
-      return rotated;
+  // source is the poppler document of the worker, when it has one of its own.
+  // the page is only measured, when page stats are passed.
+  Page analyze_document_page(const Settings& settings, Document& document,
+      const poppler::document& source, int page_index,
+      const poppler::page_renderer& renderer, MemoryBudget* budget,
+      PageStats* page_stats) {
+    auto& counters = get_work_counters();
+    const auto counters_before = counters;
+    auto page_stopwatch = std::optional<Stopwatch>();
+    if (page_stats)
+      page_stopwatch.emplace();
+
+    const auto page = std::unique_ptr<poppler::page>(
+      source.create_page(page_index));
+    auto analyzed = std::optional<Page>();
+    if (document.content)
+      analyzed = analyze_page_content(settings, *page, *document.content,
+        page_index);
+    const auto estimate = (!document.estimated.empty() &&
+      document.estimated[page_index]);
+    if (!analyzed) {
+      analyzed = analyze_page((estimate ? get_estimate_settings(settings) :
+        settings), *page, renderer, budget,
+        (page_stats ? &page_stats->render_ms : nullptr));
+      analyzed->estimated = estimate;
     }
+    set_page_size(*analyzed, *page);
 
-    if (orientation == poppler::page::seascape) {
-      auto rotated = poppler::image(h, w, poppler::image::format_gray8);
-      const auto rotated_bytes_per_row = rotated.bytes_per_row();
-      for (auto y = 0; y < h; ++y)
-        for (auto x = 0; x < w; ++x)
-          rotated.data()[x * rotated_bytes_per_row + (h - 1 - y)] =
-            image.const_data()[y * bytes_per_row + x];
-      return rotated;
+    if (page_stats) {
+      page_stats->analyze_ms = page_stopwatch->restart();
+      page_stats->pixels_scanned =
+        counters.pixels_scanned - counters_before.pixels_scanned;
+      page_stats->header_footer_iterations = counters.header_footer_iterations -
+        counters_before.header_footer_iterations;
     }
+    return *analyzed;
+  }
 
-    if (orientation == poppler::page::upside_down) {
-      auto upside_down = poppler::image(w, h, poppler::image::format_gray8);
-      for (auto y = 0; y < h; ++y)
-        for (auto x = 0; x < w; ++x)
-          upside_down.data()[(h - 1 - y) * bytes_per_row + (w - 1 - x)] =
-            image.const_data()[y * bytes_per_row + x];
-      return upside_down;
+#if !defined(_WIN32)
+  struct PageResult {
+    int page_index;
+    Page page;
+    PageStats stats;
+  };
+
+  // writes of up to PIPE_BUF bytes are atomic, so all workers share a pipe
+  static_assert(sizeof(PageResult) <= PIPE_BUF);
+
+  bool read_result(int fd, PageResult& result) {
+    auto data = reinterpret_cast<char*>(&result);
+    for (auto size = sizeof(result); size; ) {
+      const auto count = ::read(fd, data, size);
+      if (count < 0 && errno == EINTR)
+        continue;
+      if (count <= 0)
+        return false;
+      data += count;
+      size -= static_cast<size_t>(count);
     }
+    return true;
+  }
 
-    return image;
+  void write_result(int fd, const PageResult& result) {
+    while (::write(fd, &result, sizeof(result)) < 0 && errno == EINTR)
+      continue;
   }
+
+  using PageAnalyzed = std::function<void(Document&, int, const PageStats&)>;
+
+  // analyzes the pending pages of a document in forked worker processes,
+  // which do not share any poppler state. the pages are handed out using
+  // a counter in shared memory. the pending pages are reduced to the ones
+  // which were not received, when a worker failed or it was cancelled.
+  void analyze_in_processes(const Settings& settings, Document& document,
+      bool with_stats, Progress& progress, const Deadline& deadline,
+      const PageAnalyzed& on_page_analyzed) {
+    const auto pending = get_pending_count(document);
+    const auto shared = mmap(nullptr, sizeof(std::atomic<int>),
+      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+      return;
+    const auto next_pending = new (shared) std::atomic<int>(0);
+    int fds[2];
+    if (::pipe(fds) != 0) {
+      munmap(shared, sizeof(std::atomic<int>));
+      return;
+    }
+
+    auto workers = std::vector<pid_t>();
+    const auto worker_count = std::min(settings.processes, pending);
+    for (auto i = 0; i < worker_count; ++i) {
+      const auto pid = fork();
+      if (pid < 0)
+        break;
+      if (pid == 0) {
+        ::close(fds[0]);
+        auto renderer = poppler::page_renderer();
+        setup_renderer(renderer, settings);
+        for (;;) {
+          if (is_cancelled(progress, deadline))
+            break;
+          const auto j = next_pending->fetch_add(1);
+          if (j >= pending)
+            break;
+          auto result = PageResult{ document.pending_pages[j], { },
+            { document.index, document.pending_pages[j] } };
+          result.page = analyze_document_page(settings, document,
+            *document.document, result.page_index, renderer, nullptr,
+            (with_stats ? &result.stats : nullptr));
+          write_result(fds[1], result);
+        }
+        _exit(0);
+      }
+      workers.push_back(pid);
+    }
+    ::close(fds[1]);
+
+    auto received = std::vector<bool>(document.pages.size());
+    auto result = PageResult{ };
+    while (read_result(fds[0], result)) {
+      document.pages[result.page_index] = result.page;
+      received[result.page_index] = true;
+      on_page_analyzed(document, result.page_index, result.stats);
+
+      // the workers stop after their current page
+      if (is_cancelled(progress, deadline))
+        next_pending->store(pending);
+    }
+    ::close(fds[0]);
+    for (auto pid : workers)
+      waitpid(pid, nullptr, 0);
+    munmap(shared, sizeof(std::atomic<int>));
+
+    auto& pages = document.pending_pages;
+    pages.erase(std::remove_if(pages.begin(), pages.end(),
+      [&](int i) { return received[i]; }), pages.end());
+  }
+#endif
 } // namespace
 
-std::vector<Page> analyze_pages(const Settings& settings) {
+void analyze_inputs(const Settings& settings, int input_count,
+    const InputSource& next_input, const DocumentCallback& on_document_done,
+    Stats* stats, const PageCallback& on_page_done, Progress* progress) {
   // silence errors
   poppler::set_debug_error_function([](const std::string&, void*) { }, nullptr);
 
-  auto document = std::unique_ptr<poppler::document>(
-      poppler::document::load_from_file(settings.input_file.u8string()));
-  if (!document)
-    return { };
+  auto analyze_stopwatch = Stopwatch();
+  auto own_progress = Progress{ };
+  auto& analysis = (progress ? *progress : own_progress);
+  const auto deadline = get_deadline(settings);
+  auto mutex = std::mutex();
+  auto next_file = 0;
+  auto inputs_left = true;
+  auto current = std::shared_ptr<Document>();
+  auto cache = std::unique_ptr<PageCache>();
+  if (!settings.cache_file.empty())
+    cache = std::make_unique<PageCache>(settings.cache_file);
+  auto budget = std::unique_ptr<MemoryBudget>();
+  if (settings.max_memory)
+    budget = std::make_unique<MemoryBudget>(settings.max_memory);
 
-  const auto page_count = document->pages();
-  auto pages = std::vector<Page>(page_count);
+  const auto open_next_document = [&]() {
+    auto input = std::shared_ptr<const InputBuffer>();
+    if (!next_input(input)) {
+      inputs_left = false;
+      return;
+    }
+    const auto index = next_file++;
+    try {
+      current = open_document(settings, index, std::move(input));
+    }
+    catch (const std::exception&) {
+      current.reset();
+    }
+    if (!current)
+      return on_document_done(index, { }, nullptr);
 
-  const auto work = [&](int begin, int end) {
+    analysis.pages_total.fetch_add(static_cast<int>(current->pages.size()),
+      std::memory_order_relaxed);
+  };
+
+  const auto report_document = [&](Document& document) {
+    if (document.failed)
+      return on_document_done(document.index, { }, nullptr);
+    on_document_done(document.index, std::move(document.pages),
+      document.input);
+  };
+
+  // the document is reported by the thread, which completed its last page
+  const auto page_known = [&](Document& document, int i) {
+    if (complete_page(document, i, on_page_done, analysis, stats))
+      report_document(document);
+  };
+
+  // a page, which could not be analyzed, e.g. because the memory ran out,
+  // only fails its document. it is completed, so the document is reported.
+  const auto inspect = [&](Document& document, int i) {
+    try {
+      return inspect_document_page(settings, document, i, cache.get(), stats);
+    }
+    catch (const std::exception&) {
+      document.failed = true;
+      return PageState::known;
+    }
+  };
+
+  const auto page_analyzed = [&](Document& document, int i,
+      const PageStats& page_stats) {
+    if (stats)
+      stats->add_page(page_stats);
+    if (cache && !document.hashes.empty() && document.hashes[i] &&
+        !document.pages[i].estimated)
+      cache->insert(*document.hashes[i], document.pages[i]);
+    page_known(document, i);
+  };
+
+  // pages are handed out one at a time, so threads which got simple pages
+  // continue with the next instead of waiting for those with complex ones.
+  // documents are opened on demand, when the pages of the previous ones
+  // were all handed out. no more pages are handed out, once the analysis
+  // was cancelled. the pages are inspected by the threads, outside the lock.
+  auto error = std::exception_ptr();
+  const auto get_next_page = [&]() -> std::pair<std::shared_ptr<Document>, int> {
+    auto lock = std::lock_guard<std::mutex>(mutex);
+    for (;;) {
+      if (error || is_cancelled(analysis, deadline))
+        return { };
+      if (current && current->next_pending < get_pending_count(*current))
+        return { current, current->pending_pages[current->next_pending++] };
+      current.reset();
+      if (!inputs_left)
+        return { };
+      open_next_document();
+    }
+  };
+
+  const auto work = [&]() {
     auto renderer = poppler::page_renderer();
-    renderer.set_image_format(Image::format_gray8);
-    if (settings.high_quality) {
-      renderer.set_render_hint(poppler::page_renderer::antialiasing);
-      renderer.set_render_hint(poppler::page_renderer::text_antialiasing);
-      renderer.set_render_hint(poppler::page_renderer::text_hinting);
+    setup_renderer(renderer, settings);
+
+    // per-worker documents are parsed from the shared input, so workers
+    // do not contend for the locks within a single poppler document
+    auto worker_index = -1;
+    auto worker_document = std::unique_ptr<poppler::document>();
+
+    // time waiting for the next page is not busy. the time is only
+    // measured, when statistics are collected.
+    auto thread_stats = ThreadStats{ };
+    auto stopwatch = std::optional<Stopwatch>();
+    for (;;) {
+      if (stopwatch)
+        thread_stats.busy_ms += stopwatch->restart();
+      const auto [document, i] = get_next_page();
+      if (stats)
+        stopwatch.emplace();
+      if (!document)
+        break;
+
+      const auto state = inspect(*document, i);
+      if (state == PageState::waiting)
+        continue;
+      if (state == PageState::known) {
+        page_known(*document, i);
+        continue;
+      }
+
+      auto page_stats = PageStats{ document->index, i };
+      try {
+        auto source = document->document.get();
+        if (settings.worker_documents) {
+          if (worker_index != document->index) {
+            worker_document.reset();
+            worker_index = document->index;
+            worker_document = open_poppler_document(*document->input);
+          }
+          if (worker_document)
+            source = worker_document.get();
+        }
+        document->pages[i] = analyze_document_page(settings, *document,
+          *source, i, renderer, budget.get(), (stats ? &page_stats : nullptr));
+      }
+      catch (const std::exception&) {
+        document->failed = true;
+        page_known(*document, i);
+        continue;
+      }
+      ++thread_stats.pages;
+      page_analyzed(*document, i, page_stats);
     }
+    if (stats)
+      stats->add_thread(thread_stats);
+  };
 
-    for (auto i = begin; i < end; ++i) {
-      const auto page = std::unique_ptr<poppler::page>(document->create_page(i));
-      const auto image = transform(renderer.render_page(page.get(),
-        settings.resolution, settings.resolution), page->orientation());
-
-      const auto page_bounds = get_used_bounds(image, get_bounds(image));
-
-      const auto page_width = page->page_rect().width();
-      const auto page_height = page->page_rect().height();
-      const auto scale_x = page_width / image.width();
-      const auto scale_y = page_height / image.height();
-      const auto bounds_to_box = [&](const Rect& bounds) {
-        return Box{
-          bounds.left() * scale_x,
-          page_height - bounds.bottom() * scale_y,
-          bounds.right() * scale_x,
-          page_height - bounds.top() * scale_y
-        };
-      };
+  auto thread_count = settings.jobs;
+  if (thread_count <= 0)
+    thread_count = static_cast<int>(std::thread::hardware_concurrency());
 
-      pages[i].bounding_box = bounds_to_box(page_bounds);
-
-      if (settings.crop_header_size || settings.crop_footer_size) {
-        const auto header_size = guess_header_size(image, page_bounds,
-          static_cast<int>(settings.crop_header_size / scale_y));
-        const auto footer_size = guess_footer_size(image, page_bounds,
-          static_cast<int>(settings.crop_footer_size / scale_y));
-        pages[i].header = header_size * scale_y;
-        pages[i].footer = footer_size * scale_y;
-        pages[i].bounding_box_no_header = bounds_to_box(
-            get_used_bounds(image, indent_bounds(page_bounds, header_size, 0)));
-        pages[i].bounding_box_no_footer = bounds_to_box(
-            get_used_bounds(image, indent_bounds(page_bounds, 0, footer_size)));
-        pages[i].bounding_box_no_header_footer = bounds_to_box(
-            get_used_bounds(image, indent_bounds(page_bounds, header_size, footer_size)));
+  // do not start more threads than there are pages of a single document
+  if (input_count == 1) {
+    open_next_document();
+    if (!current)
+      return;
 
-#if 0 && !defined (NDEBUG)
-        if (i == 27)
-          dump_pgm("page.pgm", image, { page_bounds,
-            indent_bounds(page_bounds, header_size, footer_size) });
-#endif
+#if !defined(_WIN32)
+    // workers are forked before any threads are started. only the pages,
+    // which need to be rendered, are handed out to them. pages of failed
+    // workers are analyzed by the threads.
+    if (settings.processes > 1 && get_pending_count(*current) > 1) {
+      auto pending = std::vector<int>();
+      for (auto i : current->pending_pages) {
+        const auto state = inspect(*current, i);
+        if (state == PageState::analyze)
+          pending.push_back(i);
+        else if (state == PageState::known)
+          page_known(*current, i);
       }
+      current->pending_pages = std::move(pending);
+      analyze_in_processes(settings, *current, stats != nullptr, analysis,
+        deadline, page_analyzed);
+    }
+#endif
+    // the document was reported, when no page is left for the threads.
+    // the cache is still written.
+    thread_count = std::min(thread_count, get_pending_count(*current));
+    if (!thread_count)
+      current.reset();
+  }
+  thread_count = std::max(thread_count, 1);
+
+  // other exceptions, e.g. thrown by the callbacks, stop all threads.
+  // the first one is rethrown, once they finished.
+  const auto run = [&]() {
+    try {
+      work();
+    }
+    catch (...) {
+      auto lock = std::lock_guard<std::mutex>(mutex);
+      if (!error)
+        error = std::current_exception();
     }
   };
 
   auto threads = std::vector<std::thread>();
-  const auto pages_per_thread = page_count / std::thread::hardware_concurrency();
-  auto pos = 0;
-  for (auto i = 0u; i < std::thread::hardware_concurrency() - 1; ++i) {
-    threads.emplace_back(work, pos, pos + pages_per_thread);
-    pos += pages_per_thread;
-  }
-  work(pos, page_count);
+  for (auto i = 1; i < thread_count; ++i)
+    threads.emplace_back(run);
+  run();
   for (auto& thread : threads)
     thread.join();
+  if (error)
+    std::rethrow_exception(error);
+
+  // a document, which was opened when the analysis was cancelled, is still
+  // reported with the pages analyzed so far
+  if (current && current->pages_left > 0 && settings.partial_output)
+    report_document(*current);
+
+  if (cache)
+    cache->write();
+
+  if (stats)
+    stats->add_stage_time("analyze", analyze_stopwatch.restart());
+}
 
+void analyze_documents(const Settings& settings,
+    const std::vector<std::filesystem::path>& input_files,
+    const DocumentCallback& on_document_done, Stats* stats,
+    const PageCallback& on_page_done, Progress* progress) {
+  const auto input_count = static_cast<int>(input_files.size());
+  auto index = 0;
+  analyze_inputs(settings, input_count,
+    [&](std::shared_ptr<const InputBuffer>& input) {
+      if (index >= input_count)
+        return false;
+      input = read_input(input_files[index++]);
+      return true;
+    }, on_document_done, stats, on_page_done, progress);
+}
+
+std::vector<Page> analyze_pages(const Settings& settings,
+    std::shared_ptr<const InputBuffer> input, Stats* stats,
+    const PageCallback& on_page_done, Progress* progress) {
+  auto pages = std::vector<Page>();
+  analyze_inputs(settings, 1,
+    [&, done = false](std::shared_ptr<const InputBuffer>& next) mutable {
+      next = input;
+      return !std::exchange(done, true);
+    },
+    [&](int, std::vector<Page> document_pages,
+        std::shared_ptr<const InputBuffer>) {
+      pages = std::move(document_pages);
+    }, stats, on_page_done, progress);
   return pages;
 }
+
+std::vector<Page> analyze_pages(const Settings& settings, Stats* stats) {
+  return analyze_pages(settings, read_input(settings.input_file), stats);
+}
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "settings.h"
+#include "buffer.h"
+#include <atomic>
 #include <vector>
+#include <functional>
 
 struct Box {
   double llx;
@@ -11,6 +14,10 @@ struct Box {
 };
 
 struct Page {
+  // size of the page as it is displayed, zero when the analysis was
+  // cancelled before the page was analyzed
+  double width{ };
+  double height{ };
   Box bounding_box{ };
   double header{ };
   double footer{ };
@@ -18,6 +25,56 @@ struct Page {
   Box bounding_box_no_header{ };
   Box bounding_box_no_footer{ };
   Box bounding_box_no_header_footer{ };
+  // no ink was found, the bounding box is the whole page
+  bool blank{ };
+  // the page was not in the sample, it does not count for the statistics
+  bool estimated{ };
 };
 
-std::vector<Page> analyze_pages(const Settings& settings);
+// progress of an analysis, the counters are updated per page without
+// locking. setting cancelled stops the workers at the next page, which is
+// also safe from a signal handler. it is also set, when the timeout elapsed.
+struct Progress {
+  std::atomic<int> pages_total{ };
+  std::atomic<int> pages_done{ };
+  std::atomic<bool> cancelled{ };
+};
+
+// called when all pages of a document were analyzed, with the input which
+// can be reused for the output. pages are empty when it could not be read
+// or a page could not be analyzed.
+using DocumentCallback = std::function<void(int index, std::vector<Page> pages,
+  std::shared_ptr<const InputBuffer> input)>;
+
+// called as soon as a page was analyzed or found in the cache
+using PageCallback = std::function<void(int index, int page_index,
+  const Page& page)>;
+
+class Stats;
+
+// statistics are collected, when stats is not null. the progress is
+// updated, when it is not null. when the analysis was cancelled, the pages
+// are empty, unless a partial output was requested.
+std::vector<Page> analyze_pages(const Settings& settings,
+  std::shared_ptr<const InputBuffer> input, Stats* stats = nullptr,
+  const PageCallback& on_page_done = { }, Progress* progress = nullptr);
+std::vector<Page> analyze_pages(const Settings& settings,
+  Stats* stats = nullptr);
+
+// analyzes the pages of multiple documents, sharing the threads between them
+void analyze_documents(const Settings& settings,
+  const std::vector<std::filesystem::path>& input_files,
+  const DocumentCallback& on_document_done, Stats* stats = nullptr,
+  const PageCallback& on_page_done = { }, Progress* progress = nullptr);
+
+// returns false, when there are no more inputs. it may block until the
+// next input is available. a null input is reported as not readable.
+using InputSource = std::function<bool(std::shared_ptr<const InputBuffer>& input)>;
+
+// analyzes the inputs until the source is exhausted or the analysis was
+// cancelled. the input count is only used for limiting the threads, 0 when
+// it is not known in advance. the timeout starts with each call.
+void analyze_inputs(const Settings& settings, int input_count,
+  const InputSource& next_input, const DocumentCallback& on_document_done,
+  Stats* stats = nullptr, const PageCallback& on_page_done = { },
+  Progress* progress = nullptr);
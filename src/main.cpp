@@ -1,9 +1,205 @@
 
 #include "settings.h"
+#include "boxes.h"
 #include "input.h"
 #include "optimize.h"
 #include "output.h"
+#include "stats.h"
 #include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+  // the process runs a single analysis, which is cancelled by an interrupt
+  Progress g_progress;
+
+  // the first interrupt cancels the analysis, a second one terminates
+  void handle_interrupt(int) {
+    g_progress.cancelled = true;
+    std::signal(SIGINT, SIG_DFL);
+  }
+
+  bool is_cancelled() {
+    return g_progress.cancelled.load();
+  }
+
+  // prints the pages per second and the estimated time left to stderr,
+  // at most twice a second, by the thread which completed a page
+  class ProgressReporter {
+  public:
+    explicit ProgressReporter(bool enabled) : m_enabled(enabled) { }
+
+    void update() {
+      if (!m_enabled)
+        return;
+      const auto ms = elapsed_ms();
+      auto last_ms = m_last_ms.load();
+      if (ms - last_ms >= 500 && m_last_ms.compare_exchange_strong(last_ms, ms))
+        print(ms);
+    }
+
+    void finish() {
+      if (!m_enabled)
+        return;
+      print(elapsed_ms());
+      std::fprintf(stderr, "\n");
+    }
+
+  private:
+    int64_t elapsed_ms() const {
+      return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - m_start).count();
+    }
+
+    void print(int64_t ms) const {
+      const auto done = g_progress.pages_done.load(std::memory_order_relaxed);
+      const auto total = g_progress.pages_total.load(std::memory_order_relaxed);
+      const auto pages_per_second = done * 1000.0 / std::max(ms, int64_t{ 1 });
+      const auto seconds_left = static_cast<int>(pages_per_second > 0 ?
+        std::max(total - done, 0) / pages_per_second : 0);
+      std::fprintf(stderr, "\r%d/%d pages, %.1f pages/s, %d:%02d left ",
+        done, total, pages_per_second, seconds_left / 60, seconds_left % 60);
+    }
+
+    const bool m_enabled;
+    const std::chrono::steady_clock::time_point m_start{
+      std::chrono::steady_clock::now() };
+    std::atomic<int64_t> m_last_ms{ };
+  };
+
+  std::vector<std::filesystem::path> get_input_files(const Settings& settings) {
+    if (!settings.input_files.empty())
+      return settings.input_files;
+    return { settings.input_file };
+  }
+
+  // writes the boxes instead of the PDF, without parsing the input with QPDF
+  int analyze_files(const Settings& settings, Stats* stats,
+      ProgressReporter& progress) {
+    auto writer = BoxWriter();
+    if (!writer.open(settings.output_file, settings.analyze_only)) {
+      std::fprintf(stderr, "writing output file failed\n");
+      return 1;
+    }
+    const auto input_files = get_input_files(settings);
+    auto failed = std::atomic<int>{ };
+    analyze_documents(settings, input_files,
+      [&](int index, std::vector<Page> pages,
+          std::shared_ptr<const InputBuffer>) {
+        if (pages.empty()) {
+          std::fprintf(stderr, "%s: reading input file failed\n",
+            input_files[index].u8string().c_str());
+          ++failed;
+          return;
+        }
+        auto stopwatch = Stopwatch();
+        optimize_boxes(settings, pages);
+        if (stats)
+          stats->add_stage_time("optimize", stopwatch.restart());
+        writer.write_crop_boxes(index, pages);
+      }, stats,
+      [&](int index, int page_index, const Page& page) {
+        writer.write_page(index, page_index, page);
+        progress.update();
+      }, &g_progress);
+    progress.finish();
+    if (is_cancelled()) {
+      std::fprintf(stderr, "analysis cancelled\n");
+      return 1;
+    }
+    return (failed ? 1 : 0);
+  }
+
+  // writes the PDFs with boxes of a previous analysis, without rendering
+  int apply_boxes(const Settings& settings) {
+    const auto boxes = read_crop_boxes(settings.boxes_file);
+    if (!boxes) {
+      std::fprintf(stderr, "reading boxes file failed\n");
+      return 1;
+    }
+    const auto input_files = get_input_files(settings);
+    auto failed = 0;
+    for (auto i = 0u; i < input_files.size(); ++i) {
+      const auto filename = input_files[i].u8string();
+      try {
+        const auto input = read_input(input_files[i]);
+        if (!input)
+          throw std::runtime_error("reading input file failed");
+        auto document_settings = settings;
+        if (!settings.input_files.empty())
+          document_settings.output_file = get_output_file(settings, input_files[i]);
+        auto pages = std::vector<Page>();
+        if (i < boxes->size())
+          pages = (*boxes)[i];
+        output_pages(document_settings, *load_document(input), *input, pages);
+      }
+      catch (const std::exception& ex) {
+        std::fprintf(stderr, "%s: %s\n", filename.c_str(), ex.what());
+        ++failed;
+      }
+    }
+    return (failed ? 1 : 0);
+  }
+
+  int process_files(const Settings& settings, Stats* stats,
+      ProgressReporter& progress) {
+    const auto& input_files = settings.input_files;
+    auto processed = std::atomic<int>{ };
+    auto failed = std::atomic<int>{ };
+    auto output_mutex = std::mutex();
+    const auto report = [&](const char* format, auto... args) {
+      auto lock = std::lock_guard<std::mutex>(output_mutex);
+      std::fprintf(stderr, format, args...);
+    };
+
+    // optimizing and writing a document is done by the thread, which
+    // analyzed its last page, while the others continue with the next
+    analyze_documents(settings, input_files,
+      [&](int index, std::vector<Page> pages,
+          std::shared_ptr<const InputBuffer> input) {
+        const auto& input_file = input_files[index];
+        const auto filename = input_file.u8string();
+        if (pages.empty()) {
+          report("%s: reading input file failed\n", filename.c_str());
+          ++failed;
+          return;
+        }
+        try {
+          auto document_settings = settings;
+          document_settings.input_files.clear();
+          document_settings.input_file = input_file;
+          document_settings.output_file = get_output_file(settings, input_file);
+          auto stopwatch = Stopwatch();
+          optimize_boxes(document_settings, pages);
+          const auto optimize_ms = stopwatch.restart();
+          output_pages(document_settings, *load_document(input), *input, pages);
+          if (stats) {
+            stats->add_stage_time("optimize", optimize_ms);
+            stats->add_stage_time("output", stopwatch.restart());
+          }
+          report("%s: ok\n", filename.c_str());
+          ++processed;
+        }
+        catch (const std::exception& ex) {
+          report("%s: %s\n", filename.c_str(), ex.what());
+          ++failed;
+        }
+      }, stats,
+      [&](int, int, const Page&) { progress.update(); }, &g_progress);
+    progress.finish();
+
+    if (is_cancelled())
+      report("analysis cancelled\n");
+    report("%d of %d files processed\n", processed.load(),
+      static_cast<int>(input_files.size()));
+    return (processed.load() == static_cast<int>(input_files.size()) ? 0 : 1);
+  }
+} // namespace
 
 int main(int argc, const char* argv[]) try {
   auto settings = Settings{ };
@@ -11,15 +207,72 @@ int main(int argc, const char* argv[]) try {
     print_help_message(argv[0]);
     return 1;
   }
-  auto pages = analyze_pages(settings);
-  if (pages.empty()) {
+
+  auto stats = std::unique_ptr<Stats>();
+  if (settings.stats != StatsFormat::none)
+    stats = std::make_unique<Stats>();
+  const auto print_stats = [&]() {
+    if (stats)
+      stats->print(settings.stats, stderr);
+  };
+
+  if (!settings.boxes_file.empty())
+    return apply_boxes(settings);
+
+  std::signal(SIGINT, handle_interrupt);
+  auto progress = ProgressReporter(settings.progress);
+
+  if (settings.analyze_only != BoxFormat::none) {
+    const auto result = analyze_files(settings, stats.get(), progress);
+    print_stats();
+    return result;
+  }
+
+  if (!settings.input_files.empty()) {
+    const auto result = process_files(settings, stats.get(), progress);
+    print_stats();
+    return result;
+  }
+
+  const auto input = read_input(settings.input_file);
+  if (!input) {
     std::fprintf(stderr, "reading input file failed\n");
     return 1;
   }
 
+  // parsing the input for writing the output, overlaps with the analysis.
+  // worker processes are forked before any threads are started.
+  auto document = std::future<std::shared_ptr<QPDF>>();
+  if (settings.processes <= 1)
+    document = load_document_async(input);
+
+  auto pages = analyze_pages(settings, input, stats.get(),
+    [&](int, int, const Page&) { progress.update(); }, &g_progress);
+  progress.finish();
+  if (pages.empty()) {
+    std::fprintf(stderr, is_cancelled() ? "analysis cancelled\n" :
+      "reading input file failed\n");
+    return 1;
+  }
+  if (!document.valid())
+    document = load_document_async(input);
+
+  auto stopwatch = Stopwatch();
   optimize_boxes(settings, pages);
+  const auto optimize_ms = stopwatch.restart();
 
-  output_pages(settings, pages);
+  output_pages(settings, *document.get(), *input, pages);
+  if (stats) {
+    stats->add_stage_time("optimize", optimize_ms);
+    stats->add_stage_time("output", stopwatch.restart());
+  }
+  print_stats();
+
+  // the output only contains the pages analyzed so far
+  if (is_cancelled()) {
+    std::fprintf(stderr, "analysis cancelled, partial output written\n");
+    return 1;
+  }
   return 0;
 }
 catch (const std::exception& ex) {
@@ -2,67 +2,131 @@
 #include "optimize.h"
 #include <cmath>
 #include <algorithm>
+#include <array>
 
 namespace {
+  // range of pages, which share their statistics
+  struct Segment {
+    size_t begin;
+    size_t end;
+  };
+
   template <typename Pages, typename F>
-  void for_each_page(Pages& pages, bool even, F&& function) {
-    for (auto i = (even ? 1u : 0u); i < pages.size(); i += 2)
+  void for_each_page(Pages& pages, const Segment& segment, bool even,
+      F&& function) {
+    auto i = segment.begin;
+    if ((i % 2 == 1) != even)
+      ++i;
+    for (; i < segment.end; i += 2)
       function(pages[i]);
   }
 
-  template <typename F>
-  std::vector<double> extract_component(const std::vector<Page>& pages, bool even, F&& get) {
-    auto values = std::vector<double>();
-    values.reserve((pages.size() + 1) / 2);
-    for_each_page(pages, even, [&](const Page& page) {
-      values.push_back(get(page));
-    });
-    return values;
+  // blank pages and pages, which were not analyzed, have no content bounds
+  bool has_content(const Page& page) {
+    return (!page.blank && page.width > 0);
   }
 
-  std::vector<double> get_bounds_left(const std::vector<Page>& pages, bool even) {
-    return extract_component(pages, even,
-      [](const Page& page) { return page.bounding_box.llx; });
+  bool has_same_size(const Page& a, const Page& b) {
+    const auto tolerance = 1.0;
+    return (std::abs(a.width - b.width) <= tolerance &&
+            std::abs(a.height - b.height) <= tolerance);
   }
 
-  std::vector<double> get_bounds_right(const std::vector<Page>& pages, bool even) {
-    return extract_component(pages, even,
-      [](const Page& page) { return page.bounding_box.urx; });
+  // consecutive pages of the same size and orientation
+  std::vector<Segment> split_by_size(const std::vector<Page>& pages) {
+    auto segments = std::vector<Segment>();
+    for (auto i = size_t{ }; i < pages.size(); ++i)
+      if (!i || !has_same_size(pages[i - 1], pages[i]))
+        segments.push_back({ i, i + 1 });
+      else
+        segments.back().end = i + 1;
+    return segments;
   }
 
-  std::vector<double> get_headers(const std::vector<Page>& pages, bool even) {
-    return extract_component(pages, even,
-      [](const Page& page) { return page.header; });
-  }
+  // splits a segment where the layout changes. the mean bounds of a window
+  // of pages before and after each page are compared, which are updated in
+  // constant time using prefix sums. the windows contain as many odd as even
+  // pages, so the shift of facing pages does not count as a change.
+  void split_by_layout(const std::vector<Page>& pages, const Segment& segment,
+      std::vector<Segment>& segments) {
+    const auto window = size_t{ 8 };
+    const auto min_change = 36.0;
+    const auto count = segment.end - segment.begin;
+    if (count < 2 * window) {
+      segments.push_back(segment);
+      return;
+    }
 
-  std::vector<double> get_footers(const std::vector<Page>& pages, bool even) {
-    return extract_component(pages, even,
-      [](const Page& page) { return page.footer; });
-  }
+    using Sums = std::array<std::vector<double>, 4>;
+    auto sums = Sums();
+    auto square_sums = Sums();
+    for (auto c = 0; c < 4; ++c) {
+      sums[c].resize(count + 1);
+      square_sums[c].resize(count + 1);
+    }
+    // pages without content continue the layout of the previous page
+    auto last = std::find_if(pages.begin() + segment.begin,
+      pages.begin() + segment.end, has_content);
+    if (last == pages.begin() + segment.end)
+      last = pages.begin() + segment.begin;
+    for (auto i = size_t{ }; i < count; ++i) {
+      if (has_content(pages[segment.begin + i]))
+        last = pages.begin() + segment.begin + i;
+      const auto& box = last->bounding_box;
+      const auto values = std::array<double, 4>{
+        box.llx, box.lly, box.urx, box.ury };
+      for (auto c = 0; c < 4; ++c) {
+        sums[c][i + 1] = sums[c][i] + values[c];
+        square_sums[c][i + 1] = square_sums[c][i] + values[c] * values[c];
+      }
+    }
 
-  std::vector<double> remove_zero(std::vector<double> values) {
-    values.erase(std::remove(begin(values), end(values), 0), end(values));
-    return values;
-  }
+    // score of a change before page i, zero when there is none
+    const auto get_score = [&](size_t i) {
+      auto score = 0.0;
+      for (auto c = 0; c < 4; ++c) {
+        const auto mean = [&](const Sums& s, size_t begin, size_t end) {
+          return (s[c][end] - s[c][begin]) / (end - begin);
+        };
+        const auto variance = [&](size_t begin, size_t end) {
+          const auto m = mean(sums, begin, end);
+          return std::max(mean(square_sums, begin, end) - m * m, 0.0);
+        };
+        const auto change = std::abs(
+          mean(sums, i - window, i) - mean(sums, i, i + window));
+        const auto deviation = std::sqrt(
+          (variance(i - window, i) + variance(i, i + window)) / 2);
+        if (change > min_change && change > 3 * deviation)
+          score = std::max(score, change / (deviation + 1));
+      }
+      return score;
+    };
 
-  double calculate_mean(const std::vector<double>& values) {
-    if (values.size() < 1)
-      return 0.0;
-    auto sum = 0.0;
-    for (const auto& value : values)
-      sum += value;
-    return sum / values.size();
+    auto scores = std::vector<double>(count + 1);
+    for (auto i = window; i + window <= count; ++i)
+      scores[i] = get_score(i);
+
+    // split at the highest score within a window
+    auto begin = size_t{ };
+    for (auto i = window; i + window <= count; ++i) {
+      if (!scores[i] || i - begin < window)
+        continue;
+      const auto first = i - window + 1;
+      const auto last = std::min(i + window, count - window + 1);
+      if (std::max_element(scores.begin() + first, scores.begin() + last) !=
+          scores.begin() + i)
+        continue;
+      segments.push_back({ segment.begin + begin, segment.begin + i });
+      begin = i;
+    }
+    segments.push_back({ segment.begin + begin, segment.end });
   }
 
-  double calculate_standard_deviation(
-      const std::vector<double>& values, const double& mean_value) {
-    if (values.size() < 2)
-      return 0.0;
-    auto square_sum = 0.0;
-    const auto square = [](auto v) { return v * v; };
-    for (const auto& value : values)
-      square_sum += square(mean_value - value);
-    return std::sqrt(square_sum / (values.size() - 1));
+  std::vector<Segment> find_segments(const std::vector<Page>& pages) {
+    auto segments = std::vector<Segment>();
+    for (const auto& segment : split_by_size(pages))
+      split_by_layout(pages, segment, segments);
+    return segments;
   }
 
   struct Distribution {
@@ -74,34 +138,112 @@ namespace {
     return std::abs(value - distribution.mean) > distribution.deviation;
   }
 
-  Distribution calculate_distribution(const std::vector<double>& values) {
-    const auto mean = calculate_mean(values);
-    const auto standard_deviation = calculate_standard_deviation(values, mean);
-    return { mean, standard_deviation };
+  // accumulates mean and variance in a single pass (Welford's algorithm)
+  class Accumulator {
+  public:
+    void add(double value) {
+      ++m_count;
+      const auto delta = value - m_mean;
+      m_mean += delta / m_count;
+      m_square_sum += delta * (value - m_mean);
+    }
+
+    Distribution distribution() const {
+      return { m_mean, (m_count < 2 ? 0.0 :
+        std::sqrt(m_square_sum / (m_count - 1))) };
+    }
+
+  private:
+    int m_count{ };
+    double m_mean{ };
+    double m_square_sum{ };
+  };
+
+  double calculate_median(std::vector<double> values) {
+    if (values.empty())
+      return 0.0;
+    const auto middle = values.begin() + values.size() / 2;
+    std::nth_element(values.begin(), middle, values.end());
+    if (values.size() % 2)
+      return *middle;
+    return (*middle + *std::max_element(values.begin(), middle)) / 2;
   }
 
-  double calculate_common(std::vector<double>&& values) {
-    // calculate mean/standard deviation of all values
-    const auto distribution = calculate_distribution(values);
+  // median and median absolute deviation, which is scaled to match the
+  // standard deviation of a normal distribution. a few extreme values
+  // do not move them, like they move the mean and standard deviation.
+  Distribution calculate_robust_distribution(const std::vector<double>& values) {
+    const auto median = calculate_median(values);
+    auto deviations = std::vector<double>();
+    deviations.reserve(values.size());
+    for (const auto& value : values)
+      deviations.push_back(std::abs(value - median));
+    return { median, 1.4826 * calculate_median(std::move(deviations)) };
+  }
+
+  // the values of the pages of one parity, which are collected in
+  // a single pass, together with their distribution
+  struct Component {
+    std::vector<double> values;
+    Accumulator accumulator;
 
-    // remove outliers
-    values.erase(std::remove_if(begin(values), end(values),
-      [&](const auto value) { return is_outlier(value, distribution); }),
-      values.end());
+    void add(double value) {
+      values.push_back(value);
+      accumulator.add(value);
+    }
+
+    Distribution distribution(bool robust) const {
+      if (robust)
+        return calculate_robust_distribution(values);
+      return accumulator.distribution();
+    }
+  };
+
+  // mean of the values, which are not outliers
+  double calculate_common(const Component& component, bool robust) {
+    const auto distribution = component.distribution(robust);
+    auto sum = 0.0;
+    auto count = 0;
+    for (const auto& value : component.values)
+      if (!is_outlier(value, distribution)) {
+        sum += value;
+        ++count;
+      }
+    return (count ? sum / count : 0.0);
+  }
 
-    // calculate mean of common values
-    return calculate_mean(values);
+  // pages outside of the sample are classified using the distributions
+  // of the pages in it. pages without content are never counted.
+  auto get_sample_filter(const std::vector<Page>& pages,
+      const Segment& segment, bool even) {
+    auto has_sample = false;
+    for_each_page(pages, segment, even, [&](const Page& page) {
+      has_sample |= (has_content(page) && !page.estimated);
+    });
+    return [has_sample](const Page& page) {
+      return (has_content(page) && (!has_sample || !page.estimated));
+    };
   }
 
-  void crop_header_footer(std::vector<Page>& pages, bool even) {
-    const auto header_mean =
-      calculate_common(remove_zero(get_headers(pages, even)));
-    const auto footer_mean =
-      calculate_common(remove_zero(get_footers(pages, even)));
+  void crop_header_footer(const Settings& settings,
+      std::vector<Page>& pages, const Segment& segment, bool even) {
+    const auto in_sample = get_sample_filter(pages, segment, even);
+    auto headers = Component();
+    auto footers = Component();
+    for_each_page(pages, segment, even, [&](const Page& page) {
+      if (!in_sample(page))
+        return;
+      if (page.header)
+        headers.add(page.header);
+      if (page.footer)
+        footers.add(page.footer);
+    });
+    const auto header_mean = calculate_common(headers, settings.robust_statistics);
+    const auto footer_mean = calculate_common(footers, settings.robust_statistics);
     const auto max_header_deviation = header_mean / 2;
     const auto max_footer_deviation = footer_mean / 2;
 
-    for_each_page(pages, even, [&](Page& page) {
+    for_each_page(pages, segment, even, [&](Page& page) {
       const auto has_header = page.header &&
         !is_outlier(page.header, { header_mean, max_header_deviation });
       const auto has_footer = page.footer &&
@@ -114,14 +256,28 @@ namespace {
     });
   }
 
-  void crop_outlier(std::vector<Page>& pages, bool even) {
-    const auto left = calculate_distribution(get_bounds_left(pages, even));
-    const auto right = calculate_distribution(get_bounds_right(pages, even));
+  void crop_outlier(const Settings& settings,
+      std::vector<Page>& pages, const Segment& segment, bool even) {
+    const auto in_sample = get_sample_filter(pages, segment, even);
+    auto lefts = Component();
+    auto rights = Component();
+    for_each_page(pages, segment, even, [&](const Page& page) {
+      if (!in_sample(page))
+        return;
+      lefts.add(page.bounding_box.llx);
+      rights.add(page.bounding_box.urx);
+    });
+    if (lefts.values.empty())
+      return;
+    const auto left = lefts.distribution(settings.robust_statistics);
+    const auto right = rights.distribution(settings.robust_statistics);
 
     // find maximum bounds of common pages
     auto left_min = left.mean;
     auto right_max = right.mean;
-    for_each_page(pages, even, [&](const Page& page) {
+    for_each_page(pages, segment, even, [&](const Page& page) {
+      if (!in_sample(page))
+        return;
       if (!is_outlier(page.bounding_box.llx, left))
         left_min = std::min(left_min, page.bounding_box.llx);
       if (!is_outlier(page.bounding_box.urx, right))
@@ -129,7 +285,9 @@ namespace {
     });
 
     // clamp outliers to common page
-    for_each_page(pages, even, [&](Page& page) {
+    for_each_page(pages, segment, even, [&](Page& page) {
+      if (!has_content(page))
+        return;
       if (is_outlier(page.bounding_box.llx, left))
         page.bounding_box.llx = std::max(page.bounding_box.llx, left_min);
       if (is_outlier(page.bounding_box.urx, right))
@@ -137,8 +295,39 @@ namespace {
     });
   }
 
+  // blank pages get the common box of the other pages
+  void set_blank_boxes(const Settings& settings,
+      std::vector<Page>& pages, const Segment& segment, bool even) {
+    const auto in_sample = get_sample_filter(pages, segment, even);
+    auto components = std::array<Component, 4>();
+    for_each_page(pages, segment, even, [&](const Page& page) {
+      if (!in_sample(page))
+        return;
+      const auto& box = page.bounding_box;
+      components[0].add(box.llx);
+      components[1].add(box.lly);
+      components[2].add(box.urx);
+      components[3].add(box.ury);
+    });
+    if (components[0].values.empty())
+      return;
+
+    const auto common = [&](int c) {
+      return calculate_common(components[c], settings.robust_statistics);
+    };
+    const auto box = Box{ common(0), common(1), common(2), common(3) };
+    for_each_page(pages, segment, even, [&](Page& page) {
+      if (page.blank)
+        page.bounding_box = box;
+    });
+  }
+
   void apply_margins(const Settings& settings, std::vector<Page>& pages, bool even) {
-    for_each_page(pages, even, [&](Page& page) {
+    for_each_page(pages, Segment{ 0, pages.size() }, even, [&](Page& page) {
+      // the whole page is kept
+      if (!page.width ||
+          (page.blank && settings.blank_pages != BlankPages::common))
+        return;
       auto& box = page.bounding_box;
       box.llx -= settings.margin_left;
       box.lly -= settings.margin_bottom;
@@ -155,18 +344,26 @@ namespace {
     });
   }
 
-  void optimize_boxes(const Settings& settings, std::vector<Page>& pages, bool even) {
+  void optimize_boxes(const Settings& settings, std::vector<Page>& pages,
+      const Segment& segment, bool even) {
     if (settings.crop_footer_size || settings.crop_header_size)
-      crop_header_footer(pages, even);
+      crop_header_footer(settings, pages, segment, even);
 
     if (settings.crop_outlier)
-      crop_outlier(pages, even);
+      crop_outlier(settings, pages, segment, even);
 
-    apply_margins(settings, pages, even);
+    if (settings.blank_pages == BlankPages::common)
+      set_blank_boxes(settings, pages, segment, even);
   }
 } // namespace
 
 void optimize_boxes(const Settings& settings, std::vector<Page>& pages) {
-  optimize_boxes(settings, pages, true);
-  optimize_boxes(settings, pages, false);
+  const auto segments = (settings.segment_pages ? find_segments(pages) :
+    std::vector<Segment>{ { 0, pages.size() } });
+  for (const auto& segment : segments) {
+    optimize_boxes(settings, pages, segment, true);
+    optimize_boxes(settings, pages, segment, false);
+  }
+  apply_margins(settings, pages, true);
+  apply_margins(settings, pages, false);
 }
@@ -4,6 +4,20 @@
 #include <qpdf/QPDFPageDocumentHelper.hh>
 #include <qpdf/QPDFPageObjectHelper.hh>
 #include <qpdf/QPDFWriter.hh>
+#include <qpdf/Buffer.hh>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+#if defined(_WIN32)
+#  include <fcntl.h>
+#  include <io.h>
+#endif
 
 namespace {
   void update_box(QPDFObjectHandle& page, char const* box_name, Box box) {
@@ -25,20 +39,219 @@ namespace {
     for (auto box_name : { "/CropBox" })
       update_box(page, box_name, box);
   }
+
+  // QPDF reads objects lazily, so the input has to outlive the document
+  struct LoadedDocument {
+    std::shared_ptr<const InputBuffer> input;
+    QPDF pdf;
+  };
+
+  bool is_empty(const Box& box) {
+    return (box.urx <= box.llx || box.ury <= box.lly);
+  }
+
+  // returns whether pages were removed. pages with an empty box, which
+  // were not analyzed, since the analysis was cancelled, are not changed.
+  bool update_pages(const Settings& settings, QPDF& pdf,
+      const std::vector<Page>& pages) {
+    auto helper = QPDFPageDocumentHelper(pdf);
+    auto document_pages = helper.getAllPages();
+    if (document_pages.size() != pages.size())
+      throw std::runtime_error("page count does not match");
+    auto i = 0;
+    auto removed = false;
+    for (QPDFPageObjectHelper& ph : document_pages) {
+      if (pages[i].blank && settings.blank_pages == BlankPages::drop) {
+        helper.removePage(ph);
+        removed = true;
+      }
+      else if (!is_empty(pages[i].bounding_box)) {
+        auto page = ph.getObjectHandle();
+        update_boxes(page, pages[i].bounding_box);
+      }
+      ++i;
+    }
+    return removed;
+  }
+
+  // returns the offset of the last cross-reference section
+  std::optional<size_t> find_last_xref(const InputBuffer& input) {
+    const auto data = std::string_view(input.data(), input.size());
+    const auto tail = data.substr(data.size() - std::min(data.size(), size_t{ 1024 }));
+    const auto pos = tail.rfind("startxref");
+    if (pos == std::string_view::npos)
+      return { };
+    const auto number = std::string(tail.substr(pos + 9, 32));
+    auto end = static_cast<char*>(nullptr);
+    const auto offset = std::strtoull(number.c_str(), &end, 10);
+    if (end == number.c_str() || offset >= data.size())
+      return { };
+    return static_cast<size_t>(offset);
+  }
+
+  // returns the page dictionaries and a cross-reference section, which
+  // are appended to the unmodified input, so the time for writing depends
+  // on the page count and not on the file size. returns nothing, when the
+  // file can not be updated like this.
+  std::optional<std::string> get_incremental_update(QPDF& pdf,
+      const InputBuffer& input) {
+    if (pdf.isEncrypted() || pdf.anyWarnings() || !input.size())
+      return { };
+    const auto last_xref = find_last_xref(input);
+    if (!last_xref)
+      return { };
+
+    auto os = std::ostringstream();
+    const auto last = input.data()[input.size() - 1];
+    if (last != '\n' && last != '\r')
+      os << '\n';
+    const auto offset = [&]() {
+      return input.size() + static_cast<size_t>(os.tellp());
+    };
+
+    auto trailer = pdf.getTrailer();
+    auto size = (trailer.getKey("/Size").isInteger() ?
+      trailer.getKey("/Size").getIntValue() : 0);
+    auto objects = std::vector<std::pair<QPDFObjGen, size_t>>();
+    for (QPDFPageObjectHelper& ph : QPDFPageDocumentHelper(pdf).getAllPages()) {
+      auto page = ph.getObjectHandle();
+      const auto id = page.getObjGen();
+      objects.emplace_back(id, offset());
+      os << id.getObj() << " " << id.getGen() << " obj\n" <<
+        page.unparseResolved() << "\nendobj\n";
+      size = std::max(size, static_cast<long long>(id.getObj()) + 1);
+    }
+    std::sort(objects.begin(), objects.end(),
+      [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    auto keys = std::ostringstream();
+    for (auto key : { "/Root", "/Info", "/ID" })
+      if (trailer.hasKey(key))
+        keys << " " << key << " " << trailer.getKey(key).unparse();
+    keys << " /Prev " << *last_xref;
+
+    // files with cross-reference streams are updated with a stream
+    const auto xref_offset = offset();
+    const auto xref_stream = (std::string_view(input.data() + *last_xref,
+      input.size() - *last_xref).substr(0, 4) != "xref");
+    if (!xref_stream) {
+      os << "xref\n";
+      for (const auto& [id, object_offset] : objects) {
+        char entry[32];
+        std::snprintf(entry, sizeof(entry), "%010llu %05d n \n",
+          static_cast<unsigned long long>(object_offset), id.getGen());
+        os << id.getObj() << " 1\n" << entry;
+      }
+      os << "trailer\n<< /Size " << size << keys.str() << " >>\n";
+    }
+    else {
+      const auto xref_id = static_cast<int>(size++);
+      objects.emplace_back(QPDFObjGen(xref_id, 0), xref_offset);
+      auto index = std::ostringstream();
+      auto entries = std::string();
+      for (const auto& [id, object_offset] : objects) {
+        index << id.getObj() << " 1 ";
+        entries.push_back(1);
+        for (auto shift = 56; shift >= 0; shift -= 8)
+          entries.push_back(static_cast<char>(
+            static_cast<uint64_t>(object_offset) >> shift));
+        entries.push_back(static_cast<char>(id.getGen() >> 8));
+        entries.push_back(static_cast<char>(id.getGen()));
+      }
+      os << xref_id << " 0 obj\n<< /Type /XRef /Size " << size <<
+        " /W [1 8 2] /Index [ " << index.str() << "]" << keys.str() <<
+        " /Length " << entries.size() << " >>\nstream\n" << entries <<
+        "\nendstream\nendobj\n";
+    }
+    os << "startxref\n" << xref_offset << "\n%%EOF\n";
+    return os.str();
+  }
+
+  void set_binary_stdout() {
+#if defined(_WIN32)
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+  }
+
+  void write_updated(const std::filesystem::path& output_file,
+      const InputBuffer& input, const std::string& update) {
+    if (is_standard_stream(output_file)) {
+      set_binary_stdout();
+      std::fwrite(input.data(), 1, input.size(), stdout);
+      std::fwrite(update.data(), 1, update.size(), stdout);
+      if (std::fflush(stdout) != 0)
+        throw std::runtime_error("writing output failed");
+      return;
+    }
+    auto os = std::ofstream(output_file, std::ios::binary);
+    os.write(input.data(), static_cast<std::streamsize>(input.size()));
+    os.write(update.data(), static_cast<std::streamsize>(update.size()));
+    if (!os.good())
+      throw std::runtime_error("writing output file failed");
+  }
 } // namespace
 
-void output_pages(const Settings& settings, const std::vector<Page>& pages) {
-  auto pdf = QPDF();
+std::shared_ptr<QPDF> load_document(std::shared_ptr<const InputBuffer> input) {
+  auto document = std::make_shared<LoadedDocument>();
+  document->input = input;
+  auto& pdf = document->pdf;
   pdf.setSuppressWarnings(true);
-  pdf.processFile(settings.input_file.u8string().c_str());
+  pdf.processMemoryFile(input->name().c_str(), input->data(), input->size());
+  return std::shared_ptr<QPDF>(document, &pdf);
+}
 
-  auto i = 0;
-  for (QPDFPageObjectHelper& ph : QPDFPageDocumentHelper(pdf).getAllPages()) {
-    auto page = ph.getObjectHandle();
-    update_boxes(page, pages.at(i).bounding_box);
-    ++i;
-  }
+std::future<std::shared_ptr<QPDF>> load_document_async(
+    std::shared_ptr<const InputBuffer> input) {
+  return std::async(std::launch::async,
+    [input = std::move(input)]() { return load_document(input); });
+}
+
+void output_pages(const Settings& settings, QPDF& pdf,
+    const InputBuffer& input, const std::vector<Page>& pages) {
+  // the page tree is only appended, when no page was removed
+  const auto removed = update_pages(settings, pdf, pages);
 
+  if (!settings.full_rewrite && !removed)
+    if (const auto update = get_incremental_update(pdf, input))
+      return write_updated(settings.output_file, input, *update);
+
+  if (is_standard_stream(settings.output_file)) {
+    set_binary_stdout();
+    auto writer = QPDFWriter(pdf);
+    writer.setOutputFile("standard output", stdout, false);
+    writer.write();
+    std::fflush(stdout);
+    return;
+  }
   auto writer = QPDFWriter(pdf, settings.output_file.u8string().c_str());
   writer.write();
 }
+
+void output_pages(const Settings& settings, const std::vector<Page>& pages) {
+  const auto input = read_input(settings.input_file);
+  if (!input)
+    throw std::runtime_error("reading input file failed");
+  output_pages(settings, *load_document(input), *input, pages);
+}
+
+std::vector<char> output_pages_to_memory(const Settings& settings, QPDF& pdf,
+    const InputBuffer& input, const std::vector<Page>& pages) {
+  const auto removed = update_pages(settings, pdf, pages);
+
+  auto output = std::vector<char>();
+  if (!settings.full_rewrite && !removed)
+    if (const auto update = get_incremental_update(pdf, input)) {
+      output.reserve(input.size() + update->size());
+      output.insert(output.end(), input.data(), input.data() + input.size());
+      output.insert(output.end(), update->begin(), update->end());
+      return output;
+    }
+
+  auto writer = QPDFWriter(pdf);
+  writer.setOutputMemory();
+  writer.write();
+  const auto buffer = std::unique_ptr<Buffer>(writer.getBuffer());
+  const auto begin = reinterpret_cast<const char*>(buffer->getBuffer());
+  output.assign(begin, begin + buffer->getSize());
+  return output;
+}
@@ -1,5 +1,24 @@
 #pragma once
 
 #include "input.h"
+#include <future>
+#include <memory>
 
+class QPDF;
+
+// the document reads from the input, which is kept alive by it
+std::shared_ptr<QPDF> load_document(std::shared_ptr<const InputBuffer> input);
+
+// parses the input in the background, while the pages are analyzed
+std::future<std::shared_ptr<QPDF>> load_document_async(
+  std::shared_ptr<const InputBuffer> input);
+
+// writes to the output file, "-" writes to stdout. unless a full rewrite
+// is requested, the input is copied and only the updated pages are appended.
+void output_pages(const Settings& settings, QPDF& pdf,
+  const InputBuffer& input, const std::vector<Page>& pages);
 void output_pages(const Settings& settings, const std::vector<Page>& pages);
+
+// writes to memory instead of the output file
+std::vector<char> output_pages_to_memory(const Settings& settings, QPDF& pdf,
+  const InputBuffer& input, const std::vector<Page>& pages);
@@ -0,0 +1,447 @@
+
+#include "scan.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define SCAN_SSE2
+#  include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#endif
+
+#if defined(SCAN_SSE2) && defined(__GNUC__)
+#  define SCAN_AVX2
+#  include <immintrin.h>
+#endif
+
+namespace {
+  // find_ink returns the index of the first ink byte or width,
+  // find_last_ink the index of the last ink byte or -1
+  using FindInk = int(*)(const char* data, int width, Background background);
+
+  int lowest_bit(unsigned int mask) {
+#if defined(_MSC_VER)
+    auto index = 0ul;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+  }
+
+  int highest_bit(unsigned int mask) {
+#if defined(_MSC_VER)
+    auto index = 0ul;
+    _BitScanReverse(&index, mask);
+    return static_cast<int>(index);
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+  }
+
+  // values wrap around below low, so a single comparison remains
+  bool is_ink(char pixel, const Background& background) {
+    return static_cast<unsigned char>(static_cast<unsigned char>(pixel) -
+      background.low) > static_cast<unsigned char>(background.high - background.low);
+  }
+
+  int find_ink_scalar(const char* data, int width, Background background) {
+    for (auto x = 0; x < width; ++x)
+      if (is_ink(data[x], background))
+        return x;
+    return width;
+  }
+
+  int find_last_ink_scalar(const char* data, int width, Background background) {
+    for (auto x = width - 1; x >= 0; --x)
+      if (is_ink(data[x], background))
+        return x;
+    return -1;
+  }
+
+#if defined(SCAN_SSE2)
+  // background is where the offset from low does not exceed the range
+  unsigned int get_ink_mask_sse2(const char* data, __m128i low_16,
+      __m128i range_16) {
+    const auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    const auto offset = _mm_sub_epi8(pixels, low_16);
+    const auto background = _mm_cmpeq_epi8(_mm_max_epu8(offset, range_16), range_16);
+    return ~static_cast<unsigned int>(_mm_movemask_epi8(background)) & 0xFFFFu;
+  }
+
+  int find_ink_sse2(const char* data, int width, Background background) {
+    const auto low_16 = _mm_set1_epi8(static_cast<char>(background.low));
+    const auto range_16 = _mm_set1_epi8(
+      static_cast<char>(background.high - background.low));
+    auto x = 0;
+    for (; x + 16 <= width; x += 16)
+      if (const auto mask = get_ink_mask_sse2(data + x, low_16, range_16))
+        return x + lowest_bit(mask);
+    return x + find_ink_scalar(data + x, width - x, background);
+  }
+
+  int find_last_ink_sse2(const char* data, int width, Background background) {
+    const auto low_16 = _mm_set1_epi8(static_cast<char>(background.low));
+    const auto range_16 = _mm_set1_epi8(
+      static_cast<char>(background.high - background.low));
+    auto x = width;
+    for (; x >= 16; x -= 16)
+      if (const auto mask = get_ink_mask_sse2(data + x - 16, low_16, range_16))
+        return x - 16 + highest_bit(mask);
+    return find_last_ink_scalar(data, x, background);
+  }
+#endif // SCAN_SSE2
+
+#if defined(SCAN_AVX2)
+  __attribute__((target("avx2")))
+  unsigned int get_ink_mask_avx2(const char* data, __m256i low_32,
+      __m256i range_32) {
+    const auto pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    const auto offset = _mm256_sub_epi8(pixels, low_32);
+    const auto background = _mm256_cmpeq_epi8(
+      _mm256_max_epu8(offset, range_32), range_32);
+    return ~static_cast<unsigned int>(_mm256_movemask_epi8(background));
+  }
+
+  __attribute__((target("avx2")))
+  int find_ink_avx2(const char* data, int width, Background background) {
+    const auto low_32 = _mm256_set1_epi8(static_cast<char>(background.low));
+    const auto range_32 = _mm256_set1_epi8(
+      static_cast<char>(background.high - background.low));
+    auto x = 0;
+    for (; x + 32 <= width; x += 32)
+      if (const auto mask = get_ink_mask_avx2(data + x, low_32, range_32))
+        return x + lowest_bit(mask);
+    return x + find_ink_scalar(data + x, width - x, background);
+  }
+
+  __attribute__((target("avx2")))
+  int find_last_ink_avx2(const char* data, int width, Background background) {
+    const auto low_32 = _mm256_set1_epi8(static_cast<char>(background.low));
+    const auto range_32 = _mm256_set1_epi8(
+      static_cast<char>(background.high - background.low));
+    auto x = width;
+    for (; x >= 32; x -= 32)
+      if (const auto mask = get_ink_mask_avx2(data + x - 32, low_32, range_32))
+        return x - 32 + highest_bit(mask);
+    return find_last_ink_scalar(data, x, background);
+  }
+#endif // SCAN_AVX2
+
+  struct Kernel {
+    ScanKernel type;
+    FindInk find_ink;
+    FindInk find_last_ink;
+  };
+
+  bool is_supported(ScanKernel type) {
+    switch (type) {
+      case ScanKernel::scalar:
+        return true;
+      case ScanKernel::sse2:
+#if defined(SCAN_SSE2)
+        return true;
+#else
+        return false;
+#endif
+      case ScanKernel::avx2:
+#if defined(SCAN_AVX2)
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    }
+    return false;
+  }
+
+  Kernel make_kernel(ScanKernel type) {
+    switch (type) {
+#if defined(SCAN_AVX2)
+      case ScanKernel::avx2:
+        return { type, &find_ink_avx2, &find_last_ink_avx2 };
+#endif
+#if defined(SCAN_SSE2)
+      case ScanKernel::sse2:
+        return { type, &find_ink_sse2, &find_last_ink_sse2 };
+#endif
+      default:
+        return { ScanKernel::scalar, &find_ink_scalar, &find_last_ink_scalar };
+    }
+  }
+
+  Kernel detect_kernel() {
+    for (auto type : { ScanKernel::avx2, ScanKernel::sse2 })
+      if (is_supported(type))
+        return make_kernel(type);
+    return make_kernel(ScanKernel::scalar);
+  }
+
+  Kernel g_kernel = detect_kernel();
+  thread_local WorkCounters g_work_counters;
+
+  // noise are ink pixels, which have no ink among their neighbours
+  bool is_isolated(const Bitmap& bitmap, int x, int y,
+      const Background& background) {
+    const auto x0 = std::max(x - 1, 0);
+    const auto x1 = std::min(x + 2, bitmap.width);
+    const auto y1 = std::min(y + 2, bitmap.height);
+    for (auto yi = std::max(y - 1, 0); yi < y1; ++yi) {
+      const auto row = bitmap.data + yi * bitmap.bytes_per_row;
+      for (auto xi = x0; xi < x1; ++xi)
+        if ((xi != x || yi != y) && is_ink(row[xi], background))
+          return false;
+    }
+    return true;
+  }
+
+  // the kernels find all ink, noise is only checked for the pixels found
+  int find_ink(const Bitmap& bitmap, int y, int left, int width,
+      const Background& background) {
+    const auto data = bitmap.data + y * bitmap.bytes_per_row + left;
+    auto x = g_kernel.find_ink(data, width, background);
+    if (background.ignore_noise)
+      while (x < width && is_isolated(bitmap, left + x, y, background))
+        x += 1 + g_kernel.find_ink(data + x + 1, width - x - 1, background);
+    return x;
+  }
+
+  int find_last_ink(const Bitmap& bitmap, int y, int left, int width,
+      const Background& background) {
+    const auto data = bitmap.data + y * bitmap.bytes_per_row + left;
+    auto x = g_kernel.find_last_ink(data, width, background);
+    if (background.ignore_noise)
+      while (x >= 0 && is_isolated(bitmap, left + x, y, background))
+        x = g_kernel.find_last_ink(data, x, background);
+    return x;
+  }
+} // namespace
+
+WorkCounters& get_work_counters() {
+  return g_work_counters;
+}
+
+ScanKernel get_scan_kernel() {
+  return g_kernel.type;
+}
+
+bool set_scan_kernel(ScanKernel kernel) {
+  if (!is_supported(kernel))
+    return false;
+  g_kernel = make_kernel(kernel);
+  return true;
+}
+
+void add_histogram(Histogram& histogram, const Bitmap& bitmap, int step) {
+  for (auto y = 0; y < bitmap.height; y += step) {
+    const auto row = bitmap.data + y * bitmap.bytes_per_row;
+    for (auto x = 0; x < bitmap.width; x += step)
+      ++histogram[static_cast<unsigned char>(row[x])];
+  }
+}
+
+Background classify_background(const Histogram& histogram, char color) {
+  // too few samples to tell noise from ink
+  const auto min_samples = 256u;
+  // neither the paper nor the noise vary more than that
+  const auto max_spread = 48;
+
+  const auto value = static_cast<int>(static_cast<unsigned char>(color));
+  auto samples = 0u;
+  for (auto count : histogram)
+    samples += count;
+  if (samples < min_samples)
+    return { static_cast<unsigned char>(value),
+      static_cast<unsigned char>(value), false };
+
+  // climb to the peak, the corners may be a bit brighter or darker
+  auto peak = value;
+  for (;;) {
+    const auto below = (peak > 0 ? histogram[peak - 1] : 0u);
+    const auto above = (peak < 255 ? histogram[peak + 1] : 0u);
+    if (below > histogram[peak] && below >= above && value - peak < max_spread)
+      --peak;
+    else if (above > histogram[peak] && peak - value < max_spread)
+      ++peak;
+    else
+      break;
+  }
+
+  // values, which are a 16th as frequent as the peak, are still background.
+  // on rendered pages only the exact color is frequent.
+  const auto is_frequent = [&](int v) {
+    return histogram[v] * 16 > histogram[peak];
+  };
+  auto low = std::min(peak, value);
+  auto high = std::max(peak, value);
+  while (low > 0 && peak - low < max_spread && is_frequent(low - 1))
+    --low;
+  while (high < 255 && high - peak < max_spread && is_frequent(high + 1))
+    ++high;
+  return { static_cast<unsigned char>(low), static_cast<unsigned char>(high),
+    false };
+}
+
+bool has_color(const Bitmap& bitmap, const Bounds& rect,
+    const Background& background) {
+  const auto width = rect.right - rect.left;
+  for (auto y = rect.top; y < rect.bottom; ++y) {
+    const auto x = find_ink(bitmap, y, rect.left, width, background);
+    if (x < width) {
+      g_work_counters.pixels_scanned +=
+        static_cast<uint64_t>(y - rect.top) * width + x + 1;
+      return false;
+    }
+  }
+  g_work_counters.pixels_scanned += static_cast<uint64_t>(
+    std::max(rect.bottom - rect.top, 0)) * std::max(width, 0);
+  return true;
+}
+
+Bounds get_used_bounds(const Bitmap& bitmap, const Bounds& rect,
+    const Background& background) {
+  auto pixels = uint64_t{ };
+  const auto row_has_ink = [&](int y) {
+    const auto width = rect.right - rect.left;
+    const auto x = find_ink(bitmap, y, rect.left, width, background);
+    pixels += static_cast<uint64_t>(std::min(x + 1, width));
+    return x < width;
+  };
+
+  const auto x1 = rect.right - 1;
+  const auto y1 = rect.bottom - 1;
+
+  auto min_y = rect.top;
+  for (; min_y < y1; ++min_y)
+    if (row_has_ink(min_y))
+      break;
+
+  auto max_y = y1;
+  for (; max_y > min_y; --max_y)
+    if (row_has_ink(max_y))
+      break;
+
+  // instead of walking down the columns, scan the rows from both sides.
+  // only the part, which is not yet known to be used, is scanned.
+  auto min_x = rect.right;
+  auto max_x = rect.left - 1;
+  for (auto y = min_y; y <= max_y; ++y) {
+    if (min_x > rect.left) {
+      const auto x = rect.left + find_ink(bitmap, y, rect.left,
+        min_x - rect.left, background);
+      pixels += static_cast<uint64_t>(std::min(x + 1, min_x) - rect.left);
+      min_x = std::min(min_x, x);
+    }
+    if (max_x < x1) {
+      const auto begin = std::max(max_x + 1, rect.left);
+      const auto x = find_last_ink(bitmap, y, begin,
+        rect.right - begin, background);
+      pixels += static_cast<uint64_t>(rect.right - begin - std::max(x, 0));
+      if (x >= 0)
+        max_x = begin + x;
+    }
+  }
+  g_work_counters.pixels_scanned += pixels;
+  if (min_x > max_x) {
+    min_x = std::max(rect.left, x1);
+    max_x = x1;
+  }
+  return { min_x, min_y, max_x + 1, max_y + 1 };
+}
+
+RowProfile get_row_profile(const Bitmap& bitmap, const Bounds& rect,
+    const Background& background) {
+  const auto width = rect.right - rect.left;
+  const auto height = std::max(rect.bottom - rect.top, 0);
+  auto profile = RowProfile{ rect,
+    std::vector<int>(height, rect.right), std::vector<int>(height, rect.left) };
+  for (auto y = rect.top; y < rect.bottom; ++y) {
+    const auto left = find_ink(bitmap, y, rect.left, width, background);
+    if (left < width) {
+      profile.left[y - rect.top] = rect.left + left;
+      profile.right[y - rect.top] = rect.left + left + 1 + find_last_ink(
+        bitmap, y, rect.left + left, width - left, background);
+    }
+  }
+  // every pixel of a row is either found to be background or scanned
+  // from the right until the last ink
+  g_work_counters.pixels_scanned +=
+    static_cast<uint64_t>(height) * std::max(width, 0);
+  return profile;
+}
+
+ColumnProfile get_column_profile(const Bitmap& bitmap, const Bounds& rect,
+    const Background& background) {
+  const auto width = std::max(rect.right - rect.left, 0);
+  const auto height = std::max(rect.bottom - rect.top, 0);
+  auto profile = ColumnProfile{ rect,
+    std::vector<int>(width, rect.bottom), std::vector<int>(width, rect.top) };
+  for (auto y = rect.top; y < rect.bottom; ++y) {
+    for (auto x = find_ink(bitmap, y, rect.left, width, background); x < width;
+         x += 1 + find_ink(bitmap, y, rect.left + x + 1, width - x - 1,
+           background)) {
+      if (profile.top[x] == rect.bottom)
+        profile.top[x] = y;
+      profile.bottom[x] = y + 1;
+    }
+  }
+  g_work_counters.pixels_scanned += static_cast<uint64_t>(height) * width;
+  return profile;
+}
+
+RowProfile get_row_profile(const Bounds& rect, const std::vector<Bounds>& items) {
+  const auto height = std::max(rect.bottom - rect.top, 0);
+  auto profile = RowProfile{ rect,
+    std::vector<int>(height, rect.right), std::vector<int>(height, rect.left) };
+  for (const auto& item : items) {
+    const auto left = std::max(item.left, rect.left);
+    const auto right = std::min(item.right, rect.right);
+    if (left >= right)
+      continue;
+    const auto top = std::max(item.top, rect.top);
+    const auto bottom = std::min(item.bottom, rect.bottom);
+    for (auto y = top; y < bottom; ++y) {
+      auto& row_left = profile.left[y - rect.top];
+      auto& row_right = profile.right[y - rect.top];
+      row_left = std::min(row_left, left);
+      row_right = std::max(row_right, right);
+    }
+  }
+  return profile;
+}
+
+int find_first_used_row(const RowProfile& profile, int top, int bottom) {
+  auto y = top;
+  for (; y < bottom - 1; ++y)
+    if (profile.left[y - profile.rect.top] < profile.rect.right)
+      break;
+  return y;
+}
+
+int find_last_used_row(const RowProfile& profile, int top, int bottom) {
+  auto y = bottom - 1;
+  for (; y > top; --y)
+    if (profile.left[y - profile.rect.top] < profile.rect.right)
+      break;
+  return y;
+}
+
+Bounds get_used_bounds(const RowProfile& profile, int top, int bottom) {
+  const auto& rect = profile.rect;
+  const auto min_y = find_first_used_row(profile, top, bottom);
+  const auto max_y = find_last_used_row(profile, min_y, bottom);
+  const auto x1 = rect.right - 1;
+
+  auto min_x = rect.right;
+  auto max_x = rect.left - 1;
+  for (auto y = min_y; y <= max_y; ++y) {
+    min_x = std::min(min_x, profile.left[y - rect.top]);
+    max_x = std::max(max_x, profile.right[y - rect.top] - 1);
+  }
+  if (min_x > max_x) {
+    min_x = std::max(rect.left, x1);
+    max_x = x1;
+  }
+  return { min_x, min_y, max_x + 1, max_y + 1 };
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// rectangle within a bitmap, right and bottom are exclusive
+struct Bounds {
+  int left;
+  int top;
+  int right;
+  int bottom;
+};
+
+// gray8 bitmap, which is not owned
+struct Bitmap {
+  const char* data;
+  int width;
+  int height;
+  int bytes_per_row;
+};
+
+// pixels with values within low and high are background, all others ink.
+// when noise is ignored, ink pixels without ink neighbours are background.
+struct Background {
+  unsigned char low;
+  unsigned char high;
+  bool ignore_noise;
+};
+
+// number of pixels of each value within a sample of the bitmap
+using Histogram = std::array<uint32_t, 256>;
+
+void add_histogram(Histogram& histogram, const Bitmap& bitmap, int step);
+
+// the background is the peak of the histogram next to the guessed color,
+// extended to the values, which are still frequent, like scanner noise
+Background classify_background(const Histogram& histogram, char color);
+
+bool has_color(const Bitmap& bitmap, const Bounds& rect,
+  const Background& background);
+Bounds get_used_bounds(const Bitmap& bitmap, const Bounds& rect,
+  const Background& background);
+
+// extent of the ink in each row of a rectangle, which allows to get the used
+// bounds of a range of rows without scanning the bitmap again
+struct RowProfile {
+  Bounds rect;
+  std::vector<int> left;   // first column with ink, rect.right when empty
+  std::vector<int> right;  // one past the last column with ink
+};
+
+RowProfile get_row_profile(const Bitmap& bitmap, const Bounds& rect,
+  const Background& background);
+RowProfile get_row_profile(const Bounds& rect, const std::vector<Bounds>& items);
+int find_first_used_row(const RowProfile& profile, int top, int bottom);
+int find_last_used_row(const RowProfile& profile, int top, int bottom);
+Bounds get_used_bounds(const RowProfile& profile, int top, int bottom);
+
+// extent of the ink in each column of a rectangle, which is collected
+// while scanning the rows, for analyzing rotated pages as rendered
+struct ColumnProfile {
+  Bounds rect;
+  std::vector<int> top;     // first row with ink, rect.bottom when empty
+  std::vector<int> bottom;  // one past the last row with ink
+};
+
+ColumnProfile get_column_profile(const Bitmap& bitmap, const Bounds& rect,
+  const Background& background);
+
+// counters of the work done by the current thread
+struct WorkCounters {
+  uint64_t pixels_scanned{ };
+  uint64_t header_footer_iterations{ };
+};
+
+WorkCounters& get_work_counters();
+
+// the kernel is selected automatically, setting it is only for benchmarking
+enum class ScanKernel { scalar, sse2, avx2 };
+ScanKernel get_scan_kernel();
+bool set_scan_kernel(ScanKernel kernel);
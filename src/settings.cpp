@@ -1,6 +1,11 @@
 
 #include "settings.h"
+#include "buffer.h"
+#include <algorithm>
 #include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <set>
 
 namespace {
   std::string_view unquote(std::string_view str) {
@@ -9,30 +14,114 @@ namespace {
         return str.substr(1, str.size() - 2);
     return str;
   }
+
+  bool read_manifest(const std::filesystem::path& filename,
+      std::vector<std::filesystem::path>& input_files) {
+    auto is = std::ifstream(filename);
+    if (!is.good())
+      return false;
+    auto line = std::string();
+    while (std::getline(is, line)) {
+      if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+      if (!line.empty() && line.front() != '#')
+        input_files.push_back(std::filesystem::u8path(unquote(line)));
+    }
+    return true;
+  }
+
+  bool is_integer(const char* str) {
+    auto end = static_cast<char*>(nullptr);
+    std::strtol(str, &end, 10);
+    return (end != str && *end == '\0');
+  }
+
+  std::filesystem::path get_canonical(const std::filesystem::path& path) {
+    auto error = std::error_code();
+    const auto canonical = std::filesystem::weakly_canonical(path, error);
+    return (error ? std::filesystem::absolute(path, error) : canonical);
+  }
+
+  // an output must neither replace an input, which may still be read
+  // from a mapping, nor be written for more than one input
+  bool check_output_files(const Settings& settings) {
+    const auto single = settings.input_files.empty();
+    const auto& inputs = (single ?
+      std::vector<std::filesystem::path>{ settings.input_file } :
+      settings.input_files);
+
+    auto input_paths = std::set<std::filesystem::path>();
+    for (const auto& input : inputs)
+      if (!is_standard_stream(input))
+        input_paths.insert(get_canonical(input));
+
+    auto outputs = std::vector<std::filesystem::path>();
+    if (single || settings.analyze_only != BoxFormat::none)
+      outputs.push_back(settings.output_file);
+    else
+      for (const auto& input : inputs)
+        outputs.push_back(get_output_file(settings, input));
+
+    auto output_paths = std::set<std::filesystem::path>();
+    for (const auto& output : outputs) {
+      if (is_standard_stream(output))
+        continue;
+      const auto path = get_canonical(output);
+      if (input_paths.count(path)) {
+        std::fprintf(stderr, "%s: output would overwrite an input file\n",
+          output.u8string().c_str());
+        return false;
+      }
+      if (!output_paths.insert(path).second) {
+        std::fprintf(stderr, "%s: output is written for more than one input\n",
+          output.u8string().c_str());
+        return false;
+      }
+    }
+    return true;
+  }
 } // namespace
 
 bool interpret_commandline(Settings& settings, int argc, const char* argv[]) {
   for (auto i = 1; i < argc; i++) {
     const auto argument = std::string_view(argv[i]);
 
+    // a following number is the value, also when it is zero
     const auto get_optional_int = [&](int default_value) {
-      if (auto value = (i < argc ? std::atoi(argv[i + 1]) : 0)) {
-        ++i;
-        return value;
-      }
+      if (i + 1 < argc && is_integer(argv[i + 1]))
+        return std::atoi(argv[++i]);
       return default_value;
     };
 
     if (argument == "-i" || argument == "--input") {
       if (++i >= argc)
         return false;
-      settings.input_file = std::filesystem::u8path(unquote(argv[i]));
+      settings.input_files.push_back(std::filesystem::u8path(unquote(argv[i])));
     }
     else if (argument == "-o" || argument == "--output") {
       if (++i >= argc)
         return false;
       settings.output_file = std::filesystem::u8path(unquote(argv[i]));
     }
+    else if (argument == "-d" || argument == "--output-dir") {
+      if (++i >= argc)
+        return false;
+      settings.output_directory = std::filesystem::u8path(unquote(argv[i]));
+    }
+    else if (argument == "--manifest") {
+      if (++i >= argc)
+        return false;
+      if (!read_manifest(std::filesystem::u8path(unquote(argv[i])),
+            settings.input_files)) {
+        std::fprintf(stderr, "reading manifest file failed\n");
+        return false;
+      }
+    }
+    else if (argument == "--cache") {
+      if (++i >= argc)
+        return false;
+      settings.cache_file = std::filesystem::u8path(unquote(argv[i]));
+    }
     else if (argument == "-ch" || argument == "--crop-header") {
       settings.crop_header_size = get_optional_int(30);
     }
@@ -42,11 +131,102 @@ bool interpret_commandline(Settings& settings, int argc, const char* argv[]) {
     else if (argument == "-co" || argument == "--crop-outlier") {
       settings.crop_outlier = true;
     }
+    else if (argument == "-cb" || argument == "--content-bounds") {
+      settings.content_bounds = true;
+    }
+    else if (argument == "-sg" || argument == "--segment") {
+      settings.segment_pages = true;
+    }
+    else if (argument == "--robust") {
+      settings.robust_statistics = true;
+    }
+    else if (argument == "-pe" || argument == "--probe-edges") {
+      settings.probe_edges = true;
+    }
+    else if (argument == "-dn" || argument == "--denoise") {
+      settings.ignore_noise = true;
+    }
+    else if (argument == "--sample") {
+      if (++i >= argc)
+        return false;
+      settings.sample_pages = std::max(std::atoi(argv[i]), 0);
+    }
+    else if (argument == "--dedupe") {
+      settings.dedupe_pages = true;
+    }
+    else if (argument == "--blank-pages") {
+      if (++i >= argc)
+        return false;
+      const auto policy = std::string_view(argv[i]);
+      if (policy == "keep")
+        settings.blank_pages = BlankPages::keep;
+      else if (policy == "common")
+        settings.blank_pages = BlankPages::common;
+      else if (policy == "drop")
+        settings.blank_pages = BlankPages::drop;
+      else
+        return false;
+    }
+    else if (argument == "--analyze-only" || argument == "--analyze-only=json") {
+      settings.analyze_only = BoxFormat::json;
+    }
+    else if (argument == "--analyze-only=binary") {
+      settings.analyze_only = BoxFormat::binary;
+    }
+    else if (argument == "--apply-boxes") {
+      if (++i >= argc)
+        return false;
+      settings.boxes_file = std::filesystem::u8path(unquote(argv[i]));
+    }
+    else if (argument == "--rewrite") {
+      settings.full_rewrite = true;
+    }
     else if (argument == "-r" || argument == "--resolution") {
       if (++i >= argc)
         return false;
       settings.resolution = std::atof(argv[i]);
     }
+    else if (argument == "-rf" || argument == "--refine") {
+      if (++i >= argc)
+        return false;
+      settings.refine_resolution = std::atof(argv[i]);
+    }
+    else if (argument == "-j" || argument == "--jobs") {
+      if (++i >= argc)
+        return false;
+      settings.jobs = std::atoi(argv[i]);
+    }
+    else if (argument == "-wd" || argument == "--worker-documents") {
+      settings.worker_documents = true;
+    }
+    else if (argument == "--processes") {
+      if (++i >= argc)
+        return false;
+      settings.processes = std::atoi(argv[i]);
+    }
+    else if (argument == "--max-memory") {
+      if (++i >= argc)
+        return false;
+      settings.max_memory = static_cast<uint64_t>(
+        std::max(std::atof(argv[i]), 0.0) * 1024 * 1024);
+    }
+    else if (argument == "--progress") {
+      settings.progress = true;
+    }
+    else if (argument == "--timeout") {
+      if (++i >= argc)
+        return false;
+      settings.timeout = std::max(std::atof(argv[i]), 0.0);
+    }
+    else if (argument == "--partial") {
+      settings.partial_output = true;
+    }
+    else if (argument == "--stats" || argument == "--stats=text") {
+      settings.stats = StatsFormat::text;
+    }
+    else if (argument == "--stats=json") {
+      settings.stats = StatsFormat::json;
+    }
     else if (argument == "-m" || argument == "--margin") {
       if (++i >= argc)
         return false;
@@ -81,24 +261,53 @@ bool interpret_commandline(Settings& settings, int argc, const char* argv[]) {
         return false;
       }
     }
-    else if (i == argc - 1 && settings.input_file.empty()) {
-      settings.input_file = std::filesystem::u8path(unquote(argv[i]));
+    else if (argument == "-" ||
+             (!argument.empty() && argument.front() != '-')) {
+      settings.input_files.push_back(std::filesystem::u8path(unquote(argv[i])));
     }
     else {
       return false;
     }
   }
 
-  if (settings.input_file.empty())
+  if (settings.input_files.empty())
     return false;
 
-  if (settings.output_file.empty()) {
-    auto output = settings.input_file.u8string();
-    const auto dot = output.find_last_of('.');
-    output.insert((dot == std::string::npos ? output.size() : dot), "-cropped");
-    settings.output_file = std::filesystem::u8path(output);
+  if (settings.analyze_only != BoxFormat::none && !settings.boxes_file.empty())
+    return false;
+
+  // the boxes of all files are written to a single output, stdout by default
+  if (settings.analyze_only != BoxFormat::none && settings.output_file.empty())
+    settings.output_file = "-";
+
+  // an output filename is only allowed for a single input file
+  if (settings.input_files.size() > 1) {
+    if (!settings.output_file.empty() &&
+        settings.analyze_only == BoxFormat::none)
+      return false;
+    return check_output_files(settings);
   }
-  return true;
+
+  settings.input_file = settings.input_files.front();
+  settings.input_files.clear();
+  if (settings.output_file.empty())
+    settings.output_file = get_output_file(settings, settings.input_file);
+  return check_output_files(settings);
+}
+
+std::filesystem::path get_output_file(const Settings& settings,
+    const std::filesystem::path& input_file) {
+  // input from stdin is written to stdout
+  if (is_standard_stream(input_file))
+    return input_file;
+
+  if (!settings.output_directory.empty())
+    return settings.output_directory / input_file.filename();
+
+  auto output = input_file.u8string();
+  const auto dot = output.find_last_of('.');
+  output.insert((dot == std::string::npos ? output.size() : dot), "-cropped");
+  return std::filesystem::u8path(output);
 }
 
 void print_help_message(const char* argv0) {
@@ -120,15 +329,38 @@ void print_help_message(const char* argv0) {
   std::printf(
     "autocrop %s(c) 2020 by Albert Kalchmair\n"
     "\n"
-    "Usage: %s [-options] [input]\n"
-    "  -i,  --input <file>      input PDF filename.\n"
-    "  -o,  --output <file>     output PDF filename.\n"
+    "Usage: %s [-options] [input...]\n"
+    "  -i,  --input <file>      input PDF filename, - reads from stdin.\n"
+    "  -o,  --output <file>     output PDF filename, - writes to stdout.\n"
+    "  -d,  --output-dir <dir>  directory to write output PDF files to.\n"
+    "       --manifest <file>   file listing one input PDF filename per line.\n"
     "  -ch, --crop-header [pt]  try to crop page headers.\n"
     "  -cf, --crop-footer [pt]  try to crop page footers.\n"
     "  -co, --crop-outlier      crop pages with larger than average extent.\n"
+    "       --robust            use median instead of average for cropping.\n"
+    "  -sg, --segment           crop sections of different layout separately.\n"
+    "  -cb, --content-bounds    get bounds from page contents, when possible.\n"
+    "  -pe, --probe-edges       only render strips from the edges to the ink.\n"
+    "  -dn, --denoise           ignore isolated pixels, like scanner noise.\n"
+    "       --blank-pages <keep|common|drop>  handling of blank pages (default: keep).\n"
+    "       --sample <n>        analyze n pages exactly and estimate the others.\n"
+    "       --dedupe            analyze pages with identical contents once.\n"
     "  -m,  --margin <pt>       margin to add to each cropped page (default: %.0f).\n"
     "      also available: margin-left, -right, -top, -bottom, -inner, -outer\n"
     "  -r,  --resolution <dpi>  resolution of internal rendering (default: %.0f).\n"
+    "  -rf, --refine <dpi>      refine bounds by rendering edges at higher resolution.\n"
+    "       --cache <file>      reuse analysis results stored in file.\n"
+    "       --rewrite           rewrite whole file instead of appending changes.\n"
+    "       --analyze-only[=binary]  write boxes as JSON lines instead of PDF.\n"
+    "       --apply-boxes <file>  write PDF with boxes written by analyze-only.\n"
+    "  -j,  --jobs <n>          number of threads (default: number of cores).\n"
+    "  -wd, --worker-documents  let each thread parse the document on its own.\n"
+    "       --processes <n>     analyze a single document in forked processes.\n"
+    "       --max-memory <MiB>  memory for rendering pages (default: unlimited).\n"
+    "       --stats[=json]      print timings and counters to stderr.\n"
+    "       --progress          print pages per second and time left to stderr.\n"
+    "       --timeout <s>       cancel the analysis after the seconds.\n"
+    "       --partial           write the pages analyzed until it was cancelled.\n"
     "  -h,  --help              print this help.\n"
     "\n"
     "All Rights Reserved.\n"
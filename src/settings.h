@@ -2,15 +2,58 @@
 
 #include <filesystem>
 #include <array>
+#include <cstdint>
+#include <vector>
+
+enum class StatsFormat { none, text, json };
+enum class BoxFormat { none, json, binary };
+// blank pages are kept uncropped, get the common box or are removed
+enum class BlankPages { keep, common, drop };
 
 struct Settings {
   std::filesystem::path input_file;
   std::filesystem::path output_file;
+  // all input files, when more than one is processed
+  std::vector<std::filesystem::path> input_files;
+  std::filesystem::path output_directory;
+  std::filesystem::path cache_file;
+  // write the analyzed boxes to the output file instead of a PDF
+  BoxFormat analyze_only{ };
+  // write a PDF with the boxes read from this file, without analyzing
+  std::filesystem::path boxes_file;
   double crop_header_size{ };
   double crop_footer_size{ };
   bool crop_outlier{ };
+  bool robust_statistics{ };
+  bool segment_pages{ };
+  bool content_bounds{ };
+  bool probe_edges{ };
+  // ignore ink pixels without ink neighbours, like scanner noise
+  bool ignore_noise{ };
+  BlankPages blank_pages{ };
+  // pages analyzed at full resolution for the statistics of large documents,
+  // the others are only estimated. all pages are analyzed when zero.
+  int sample_pages{ };
+  // pages with identical contents are analyzed once
+  bool dedupe_pages{ };
   bool high_quality{ true };
   double resolution{ 96 };
+  double refine_resolution{ };
+  // rewrite the whole file, instead of appending the updated pages
+  bool full_rewrite{ };
+  int jobs{ };
+  // each thread parses the document on its own
+  bool worker_documents{ };
+  // number of forked processes analyzing a single document
+  int processes{ };
+  // memory for rendering pages in bytes, unlimited when zero
+  uint64_t max_memory{ };
+  StatsFormat stats{ };
+  bool progress{ };
+  // seconds until the analysis is cancelled, unlimited when zero
+  double timeout{ };
+  // write the pages analyzed until the analysis was cancelled
+  bool partial_output{ };
   double margin_top{ 5 };
   double margin_bottom{ 5 };
   double margin_right{ 5 };
@@ -21,3 +64,5 @@ struct Settings {
 
 bool interpret_commandline(Settings& settings, int argc, const char* argv[]);
 void print_help_message(const char* argv0);
+std::filesystem::path get_output_file(const Settings& settings,
+  const std::filesystem::path& input_file);
@@ -0,0 +1,131 @@
+
+#include "stats.h"
+#include <algorithm>
+#include <cinttypes>
+#include <tuple>
+
+#if defined(_WIN32)
+#  define NOMINMAX
+#  include <windows.h>
+#  include <psapi.h>
+#else
+#  include <sys/resource.h>
+#endif
+
+void Stats::add_page(const PageStats& page) {
+  auto lock = std::lock_guard(m_mutex);
+  m_pages.push_back(page);
+}
+
+void Stats::add_thread(const ThreadStats& thread) {
+  auto lock = std::lock_guard(m_mutex);
+  m_threads.push_back(thread);
+}
+
+void Stats::add_saved_renders(int count) {
+  auto lock = std::lock_guard(m_mutex);
+  m_saved_renders += count;
+}
+
+void Stats::add_stage_time(const std::string& stage, double ms) {
+  auto lock = std::lock_guard(m_mutex);
+  const auto it = std::find_if(m_stages.begin(), m_stages.end(),
+    [&](const auto& s) { return s.first == stage; });
+  if (it != m_stages.end())
+    it->second += ms;
+  else
+    m_stages.emplace_back(stage, ms);
+}
+
+void Stats::print(StatsFormat format, std::FILE* file) const {
+  auto lock = std::lock_guard(m_mutex);
+  auto pages = m_pages;
+  std::sort(pages.begin(), pages.end(), [](const auto& a, const auto& b) {
+    return std::tie(a.document, a.page) < std::tie(b.document, b.page);
+  });
+
+  auto total = PageStats{ };
+  for (const auto& page : pages) {
+    total.render_ms += page.render_ms;
+    total.analyze_ms += page.analyze_ms;
+    total.pixels_scanned += page.pixels_scanned;
+    total.header_footer_iterations += page.header_footer_iterations;
+  }
+
+  // threads are idle while they wait for pages or for the others to finish
+  const auto stage_time = [&](const char* stage) {
+    for (const auto& [name, ms] : m_stages)
+      if (name == stage)
+        return ms;
+    return 0.0;
+  };
+  const auto analyze_ms = stage_time("analyze");
+  const auto idle_ms = [&](const ThreadStats& thread) {
+    return std::max(analyze_ms - thread.busy_ms, 0.0);
+  };
+  const auto peak_memory = get_peak_memory();
+
+  if (format == StatsFormat::json) {
+    std::fprintf(file, "{\"stages\": {");
+    for (auto i = 0u; i < m_stages.size(); ++i)
+      std::fprintf(file, "%s\"%s\": %.3f", (i ? ", " : ""),
+        m_stages[i].first.c_str(), m_stages[i].second);
+    std::fprintf(file, "}, \"peak_memory\": %" PRIu64 ", \"saved_renders\": %d, "
+      "\"threads\": [", peak_memory, m_saved_renders);
+    for (auto i = 0u; i < m_threads.size(); ++i)
+      std::fprintf(file, "%s{\"pages\": %d, \"busy_ms\": %.3f, \"idle_ms\": %.3f}",
+        (i ? ", " : ""), m_threads[i].pages, m_threads[i].busy_ms,
+        idle_ms(m_threads[i]));
+    std::fprintf(file, "], \"pages\": [");
+    for (auto i = 0u; i < pages.size(); ++i) {
+      const auto& page = pages[i];
+      std::fprintf(file, "%s{\"document\": %d, \"page\": %d, "
+        "\"render_ms\": %.3f, \"analyze_ms\": %.3f, \"pixels_scanned\": %" PRIu64
+        ", \"header_footer_iterations\": %" PRIu64 "}",
+        (i ? ", " : ""), page.document, page.page, page.render_ms,
+        page.analyze_ms, page.pixels_scanned, page.header_footer_iterations);
+    }
+    std::fprintf(file, "]}\n");
+    return;
+  }
+
+  std::fprintf(file, "stages:\n");
+  for (const auto& [name, ms] : m_stages)
+    std::fprintf(file, "  %-10s %10.3f ms\n", name.c_str(), ms);
+  std::fprintf(file, "pages analyzed: %d\n", static_cast<int>(pages.size()));
+  if (!pages.empty()) {
+    const auto count = static_cast<double>(pages.size());
+    std::fprintf(file, "  render     %10.3f ms (%.3f ms/page)\n",
+      total.render_ms, total.render_ms / count);
+    std::fprintf(file, "  analyze    %10.3f ms (%.3f ms/page)\n",
+      total.analyze_ms, total.analyze_ms / count);
+    std::fprintf(file, "  pixels scanned: %" PRIu64 "\n", total.pixels_scanned);
+    std::fprintf(file, "  header/footer iterations: %" PRIu64 "\n",
+      total.header_footer_iterations);
+  }
+  std::fprintf(file, "renders saved by identical pages: %d\n", m_saved_renders);
+  std::fprintf(file, "threads: %d\n", static_cast<int>(m_threads.size()));
+  for (auto i = 0u; i < m_threads.size(); ++i)
+    std::fprintf(file, "  #%-3u %5d pages, busy %10.3f ms, idle %10.3f ms\n",
+      i, m_threads[i].pages, m_threads[i].busy_ms, idle_ms(m_threads[i]));
+  std::fprintf(file, "peak memory: %.1f MiB\n",
+    static_cast<double>(peak_memory) / (1024 * 1024));
+}
+
+uint64_t get_peak_memory() {
+#if defined(_WIN32)
+  auto counters = PROCESS_MEMORY_COUNTERS{ };
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0;
+  return counters.PeakWorkingSetSize;
+#else
+  auto usage = rusage{ };
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+# if defined(__APPLE__)
+  return static_cast<uint64_t>(usage.ru_maxrss);
+# else
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+# endif
+#endif
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "settings.h"
+#include "scan.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct PageStats {
+  int document{ };
+  int page{ };
+  double render_ms{ };
+  double analyze_ms{ };
+  uint64_t pixels_scanned{ };
+  uint64_t header_footer_iterations{ };
+};
+
+struct ThreadStats {
+  double busy_ms{ };
+  int pages{ };
+};
+
+class Stopwatch {
+public:
+  // returns the milliseconds since construction or the last restart
+  double restart() {
+    const auto now = std::chrono::steady_clock::now();
+    const auto elapsed = std::chrono::duration<double, std::milli>(
+      now - m_start).count();
+    m_start = now;
+    return elapsed;
+  }
+
+private:
+  std::chrono::steady_clock::time_point m_start{
+    std::chrono::steady_clock::now() };
+};
+
+// collects the statistics of all threads
+class Stats {
+public:
+  void add_page(const PageStats& page);
+  void add_thread(const ThreadStats& thread);
+  // pages which got the result of an identical page, without rendering
+  void add_saved_renders(int count);
+  void add_stage_time(const std::string& stage, double ms);
+  void print(StatsFormat format, std::FILE* file) const;
+
+private:
+  mutable std::mutex m_mutex;
+  std::vector<PageStats> m_pages;
+  std::vector<ThreadStats> m_threads;
+  int m_saved_renders{ };
+  std::vector<std::pair<std::string, double>> m_stages;
+};
+
+// peak resident memory of the process in bytes
+uint64_t get_peak_memory();